@@ -0,0 +1,250 @@
+#include "connection.h"
+#include "connectionman.h"
+#include "gui.h"
+
+#include <QtTest>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTableWidget>
+#include <QTcpSocket>
+#include <QTextBrowser>
+#include <QThread>
+
+#include <algorithm>
+
+// Микробенчмарки горячих функций сервера, вызываемых на каждое сообщение.
+// Каждая стадия измеряется отдельно на коротких, средних и длинных
+// сообщениях. Для машиночитаемого вывода: ./Bench -o result.csv,csv
+// (или -xml / -txt), для стабильности: -median 9 -minimumvalue 100
+
+namespace
+{
+
+constexpr int kFrames = 1000;  // кадров в записанном потоке
+constexpr int kBatch = 1001;   // замеров в стадиях с ручным хронометражем
+
+QJsonObject ShortMessage()
+{
+  QJsonObject obj;
+  obj["type"] = "DeviceStatus";
+  obj["uptime"] = "36000";
+  obj["cpu_usage"] = 25;
+  obj["memory_usage"] = 60;
+  return obj;
+}
+
+QJsonObject MediumMessage()
+{
+  QJsonObject obj;
+  obj["type"] = "NetworkMetrics";
+  obj["bandwidth"] = "100.50";
+  obj["latency"] = "12.30";
+  obj["packet_loss"] = "0.01";
+  obj["interface"] = "eth0";
+  obj["note"] = QString(80, QChar('m'));
+  return obj;
+}
+
+QJsonObject LongMessage()
+{
+  QJsonObject obj;
+  obj["type"] = "Log";
+  obj["severity"] = "INFO";
+  obj["message"] = QString("Interface eth0 restarted ").repeated(16);
+  return obj;
+}
+
+void AddSizeRows()
+{
+  QTest::newRow("short") << ShortMessage();
+  QTest::newRow("medium") << MediumMessage();
+  QTest::newRow("long") << LongMessage();
+}
+
+}  // namespace
+
+class ServerBench : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void ReadFrames_data();
+  void ReadFrames();
+  void SendJsonEncode_data();
+  void SendJsonEncode();
+  void LaneDelivery_data();
+  void LaneDelivery();
+  void InsertMessageRow_data();
+  void InsertMessageRow();
+  void LogAppend();
+};
+
+void ServerBench::ReadFrames_data()
+{
+  QTest::addColumn<QJsonObject>("msg");
+  AddSizeRows();
+}
+
+// разбор кадров и JSON из заранее записанного потока байт
+void ServerBench::ReadFrames()
+{
+  QFETCH(QJsonObject, msg);
+
+  QByteArray stream;
+  auto frame = Connection::Frame(msg);
+  for(int i = 0; i < kFrames; ++i)
+    stream.append(frame);
+
+  Connection conn("Bench", new QTcpSocket());
+  int parsed = 0;
+  QJsonObject last;
+  connect(&conn, &Connection::JsonObject, [&parsed, &last](const QJsonObject &obj, const MsgTrace &) {
+    ++parsed;
+    last = obj;
+  });
+
+  QBENCHMARK {
+    parsed = 0;
+    QBuffer buf(&stream);
+    buf.open(QIODevice::ReadOnly);
+    conn.ReadFrames(&buf);
+    QCOMPARE(parsed, kFrames);
+  }
+
+  QCOMPARE(last, msg);
+}
+
+void ServerBench::SendJsonEncode_data()
+{
+  QTest::addColumn<QJsonObject>("msg");
+  AddSizeRows();
+}
+
+// кодирование объекта в кадр, выполняемое в SendJson
+void ServerBench::SendJsonEncode()
+{
+  QFETCH(QJsonObject, msg);
+
+  qsizetype total = 0;
+  QBENCHMARK {
+    total += Connection::Frame(msg).size();
+  }
+  QVERIFY(total > 0);
+}
+
+void ServerBench::LaneDelivery_data()
+{
+  QTest::addColumn<QJsonObject>("msg");
+  AddSizeRows();
+}
+
+// доставка через LaneQueue из потока бизнес-логики в поток GUI (пачка kFrames)
+void ServerBench::LaneDelivery()
+{
+  QFETCH(QJsonObject, msg);
+
+  QThread thread;
+  auto man = new ConnectionMan(0);
+  man->moveToThread(&thread);
+  connect(&thread, &QThread::finished, man, &QObject::deleteLater);
+  thread.start();
+
+  QObject receiver;
+  QEventLoop loop;
+  int delivered = 0;
+  connect(man, &ConnectionMan::DataPending, &receiver, [&]() {
+    bool more = true;
+    while(more)
+      delivered += man->Lanes().Take(200, &more).size();
+    if(delivered == kFrames)
+      loop.quit();
+  }, Qt::QueuedConnection);
+
+  auto lane = ClassifyLane(msg);
+  QBENCHMARK {
+    delivered = 0;
+    QMetaObject::invokeMethod(man, [man, msg, lane]() {
+      for(int i = 0; i < kFrames; ++i)
+        if(man->Lanes().Push(lane, {"Bench", msg, MsgTrace()}))
+          emit man->DataPending();
+    }, Qt::QueuedConnection);
+    loop.exec();
+  }
+
+  thread.quit();
+  thread.wait();
+}
+
+void ServerBench::InsertMessageRow_data()
+{
+  QTest::addColumn<QJsonObject>("msg");
+  QTest::addColumn<int>("rows");
+
+  const QList<QPair<QByteArray, QJsonObject>> sizes = {
+    {"short", ShortMessage()},
+    {"medium", MediumMessage()},
+    {"long", LongMessage()}};
+
+  for(const auto &s : sizes)
+    for(int rows : {0, 1000, 10000})
+      QTest::addRow("%s/%d", s.first.constData(), rows) << s.second << rows;
+}
+
+// вставка строки в таблицу сообщений при заданном её размере. Вставленная
+// строка удаляется вне замера, так что размер таблицы не зависит от числа
+// прогонов; результат - медиана по kBatch вставкам
+void ServerBench::InsertMessageRow()
+{
+  QFETCH(QJsonObject, msg);
+  QFETCH(int, rows);
+
+  CentralWidget cw;
+  auto table = cw.findChild<QTableWidget*>("messages");
+  QVERIFY(table);
+
+  for(int i = 0; i < rows; ++i)
+    QMetaObject::invokeMethod(&cw, "InsertMessageRow", Qt::DirectConnection,
+                              Q_ARG(QString, "Bench"), Q_ARG(QJsonObject, msg));
+
+  QList<qint64> ns;
+  ns.reserve(kBatch);
+  QElapsedTimer timer;
+  for(int i = 0; i < kBatch; ++i) {
+    timer.start();
+    QMetaObject::invokeMethod(&cw, "InsertMessageRow", Qt::DirectConnection,
+                              Q_ARG(QString, "Bench"), Q_ARG(QJsonObject, msg));
+    ns << timer.nsecsElapsed();
+    table->removeRow(table->rowCount() - 1);
+  }
+  QCOMPARE(table->rowCount(), rows);
+
+  std::sort(ns.begin(), ns.end());
+  QTest::setBenchmarkResult(ns.at(kBatch / 2), QTest::WalltimeNanoseconds);
+}
+
+// дописывание строки в журнал - отдельная стадия обработки сообщения;
+// журнал создаётся заново и за замер растёт ровно на kBatch строк
+void ServerBench::LogAppend()
+{
+  QList<qint64> ns;
+  ns.reserve(kBatch);
+  QElapsedTimer timer;
+
+  CentralWidget cw;
+  auto log = cw.findChild<QTextBrowser*>("log");
+  QVERIFY(log);
+  for(int i = 0; i < kBatch; ++i) {
+    timer.start();
+    QMetaObject::invokeMethod(&cw, "OnLogMessage", Qt::DirectConnection,
+                              Q_ARG(QString, "Data from Bench: DeviceStatus"));
+    ns << timer.nsecsElapsed();
+  }
+  QCOMPARE(log->document()->blockCount(), kBatch);
+
+  std::sort(ns.begin(), ns.end());
+  QTest::setBenchmarkResult(ns.at(kBatch / 2), QTest::WalltimeNanoseconds);
+}
+
+QTEST_MAIN(ServerBench)
+#include "bench.moc"
@@ -3,11 +3,20 @@ TEMPLATE = app
 QT += core network
 CONFIG += console c++17
 
+INCLUDEPATH += ../Server
+
 HEADERS += \
-    client.h
+    ../Server/lanes.h \
+    ../Server/lanewriter.h \
+    ../Server/localtransport.h \
+    client.h \
+    hostcollector.h
 
 SOURCES += \
+    ../Server/lanewriter.cpp \
+    ../Server/localtransport.cpp \
     main.cpp \
-    client.cpp
+    client.cpp \
+    hostcollector.cpp
 
 
@@ -7,12 +7,14 @@
 #include <QDebug>
 #include <QRandomGenerator>
 #include <QDataStream>
+#include <QHostAddress>
 
 Client::Client(QObject *parent) : QObject(parent)
 {
   static constexpr int rInterval = 1000 * 5; // 5sec интервал переподключения
   recTimer_.setInterval(rInterval);
   sendTimer_.setSingleShot(true);
+  statsTimer_.setInterval(5000);
 
   appTimer_.start();
 
@@ -20,13 +22,20 @@ Client::Client(QObject *parent) : QObject(parent)
   connect(&socket_, &QTcpSocket::disconnected, this, &Client::OnDisconnected);
   connect(&socket_, &QTcpSocket::readyRead, this, &Client::OnReadyRead);
   connect(&socket_, &QAbstractSocket::errorOccurred,this, &Client::OnSocketError);
+  connect(&localSocket_, &QLocalSocket::connected, this, &Client::OnConnected);
+  connect(&localSocket_, &QLocalSocket::disconnected, this, &Client::OnDisconnected);
+  connect(&localSocket_, &QLocalSocket::readyRead, this, &Client::OnReadyRead);
+  connect(&localSocket_, &QLocalSocket::errorOccurred, this, &Client::OnLocalSocketError);
   connect(&recTimer_, &QTimer::timeout, this, &Client::Reconnect);
   connect(&sendTimer_, &QTimer::timeout, this, &Client::SendDataToServer);
+  connect(&statsTimer_, &QTimer::timeout, this, &Client::PrintLaneStats);
+  connect(&writer_, &LaneWriter::BulkSpace, this, &Client::PumpLogChunks);
 }
 
 Client::~Client()
 {
   socket_.close();
+  localSocket_.close();
 }
 
 void Client::Start(const QString &host, quint16 port)
@@ -37,32 +46,77 @@ void Client::Start(const QString &host, quint16 port)
   Reconnect();
 }
 
+bool Client::EnableCollector(int hz, QString *error)
+{
+  auto collector = std::make_unique<HostCollector>();
+  if(!collector->Open(error))
+    return false;
+
+  collector_ = std::move(collector);
+  sampleHz_ = hz;
+  return true;
+}
+
 void Client::Reconnect()
 {
-  if(socket_.state() == QAbstractSocket::ConnectedState)
+  if(IsConnected())
     return;
 
+  // на той же машине сначала локальный сокет, при неудаче - TCP
+  if(!localFailed_ && IsLocalHost()) {
+    dev_ = &localSocket_;
+    writer_.SetDevice(dev_);
+    qDebug() << QString("Connecting to local socket %1 ...").arg(LocalServerName(port_));
+    localSocket_.connectToServer(LocalServerName(port_));
+    return;
+  }
+
+  dev_ = &socket_;
+  writer_.SetDevice(dev_);
   qDebug() << QString("Connecting to %1:%2 ...").arg(host_).arg(port_);
   socket_.connectToHost(host_, port_);
 }
 
+bool Client::IsConnected() const
+{
+  return socket_.state() == QAbstractSocket::ConnectedState
+         || localSocket_.state() == QLocalSocket::ConnectedState;
+}
+
+bool Client::IsLocalHost() const
+{
+  return host_ == "localhost" || QHostAddress(host_).isLoopback();
+}
+
 void Client::OnConnected()
 {
-  qDebug() << "Connected";
+  qDebug() << (dev_ == &localSocket_ ? "Connected (local socket)" : "Connected");
+  connected_ = true;
   recTimer_.stop();
+  if(laneStats_)
+    statsTimer_.start();
 }
 
 void Client::OnDisconnected()
 {
   qDebug() << "Disconnected";
+  connected_ = false;
+  localFailed_ = false;
+  ring_.reset();
   started_ = false;
+  if(collector_)
+    collector_->Stop();
+  report_.clear();
+  writer_.Clear();
+  logStreams_.clear();
   sendTimer_.stop();
+  statsTimer_.stop();
   recTimer_.start();
 }
 
 void Client::OnReadyRead()
 {
-  QDataStream in(&socket_);
+  QDataStream in(dev_);
   in.setVersion(QDataStream::Qt_6_0);
 
   forever {
@@ -92,6 +146,20 @@ void Client::OnReadyRead()
 void Client::OnSocketError(QAbstractSocket::SocketError)
 {
   qCritical() << "Socket error:" << socket_.errorString();
+  localFailed_ = false; // при следующей попытке снова сначала локальный сокет
+  recTimer_.start();
+}
+
+void Client::OnLocalSocketError(QLocalSocket::LocalSocketError)
+{
+  if(!connected_) {
+    qWarning() << "Local socket unavailable:" << localSocket_.errorString() << "- using TCP";
+    localFailed_ = true;
+    Reconnect();
+    return;
+  }
+
+  qCritical() << "Socket error:" << localSocket_.errorString();
   recTimer_.start();
 }
 
@@ -104,33 +172,107 @@ void Client::ProcessJSON(const QJsonObject &obj)
   if(type == "ConnectAck") {
     qDebug() << "ID:" << obj.value("clientId").toString();
 
+    auto key = obj.value("shm").toString();
+    if(!key.isEmpty()) {
+      ring_ = std::make_unique<ShmRing>(key);
+      if(ring_->Attach()) {
+        qDebug() << "Using shared memory transport";
+      } else {
+        qWarning() << "Shared memory unavailable:" << ring_->ErrorString();
+        ring_.reset();
+      }
+    }
+
+  } else if(type == "SnapshotAck") {
+    auto &st = report_[obj.value("of").toString()];
+    auto snap = obj.value("snap").toInteger();
+    for(const auto &p : st.pending) {
+      if(!p.snap || p.snap != snap || snap <= st.ackedSnap)
+        continue;
+      st.acked = p.obj;
+      st.ackedSnap = snap;
+      // ждать следующего подтверждения не меньше двух RTT
+      st.ackWaitMs = qMax(kAckWaitMs, 2 * (appTimer_.elapsed() - p.sentMs));
+    }
+
   } else if(type == "Command") {
     auto cmd = obj.value("command").toString();
     qDebug() << cmd;
 
     if(cmd == "start") {
       cpuWarn_ = obj.value("cpuWarn").toInt();
+      policy_ = obj.value("policy").toObject();
+      fullInterval_ = obj.value("fullInterval").toInteger(60000);
+      report_.clear();
       started_ = true;
+      if(collector_)
+        collector_->Start(sampleHz_);
       sendTimer_.start(RndInt(10, 100));
     } else if (cmd == "stop") {
       started_ = false;
       sendTimer_.stop();
+      if(collector_)
+        collector_->Stop();
+    } else if (cmd == "resync") {
+      // сервер потерял базовый снимок - следующая отправка будет полной
+      report_.remove(obj.value("of").toString());
     }
   }
 }
 
 void Client::SendJson(const QJsonObject &obj)
 {
-  if(socket_.state() != QAbstractSocket::ConnectedState)
+  if(!IsConnected())
+    return;
+
+  // метки для трассировки задержки на сервере
+  auto stamped = obj;
+  stamped["seq"] = ++seq_;
+  stamped["sentAt"] = QDateTime::currentMSecsSinceEpoch();
+
+  auto json = QJsonDocument(stamped).toJson(QJsonDocument::Compact);
+  auto lane = ClassifyLane(obj);
+  auto droppable = IsDroppable(obj);
+
+  // телеметрия - через разделяемую память, High - через сокет, чтобы
+  // сервер увидел это сразу. Части длинного лога всегда идут через сокет:
+  // при переходе между транспортами они пришли бы не по порядку
+  if(ring_ && lane == Lane::Bulk && droppable) {
+    bool wasEmpty = false;
+    if(!ring_->Write(json, &wasEmpty)) {
+      // запись через сокет обогнала бы ещё не прочитанные записи буфера,
+      // поэтому при переполнении телеметрия отбрасывается, как в LaneWriter
+      ringDropped_++;
+      return;
+    }
+    // сервер не опрашивает буфер: если он всё вычитал, его нужно разбудить
+    if(wasEmpty)
+      writer_.Write(Lane::High, ShmRing::Doorbell());
     return;
+  }
 
   QByteArray data;
   QDataStream out(&data, QIODevice::WriteOnly);
   out.setVersion(QDataStream::Qt_6_0);
 
-  out << QJsonDocument(obj).toJson(QJsonDocument::Compact);
-  socket_.write(data);
-  socket_.flush();
+  out << json;
+  writer_.Write(lane, data, droppable);
+}
+
+void Client::PrintLaneStats()
+{
+  for(auto lane : {Lane::High, Lane::Bulk}) {
+    auto st = writer_.Stats(lane);
+    if(!st.maxDepth && !st.dropped)
+      continue;
+    qDebug() << QString("Lane %1: depth %2 (max %3), max wait %4 ms, dropped %5")
+                    .arg(LaneName(lane)).arg(st.depth).arg(st.maxDepth)
+                    .arg(st.maxWaitMs).arg(st.dropped);
+  }
+  if(ringDropped_)
+    qDebug() << QString("Shared memory ring full: dropped %1 records").arg(ringDropped_);
+  ringDropped_ = 0;
+  writer_.ResetStats();
 }
 
 qint32 Client::RndInt(qint32 from, qint32 to) const noexcept
@@ -151,24 +293,44 @@ void Client::SendDataToServer()
   switch (t) {
     case 0: {
       obj["type"] = "NetworkMetrics";
-      obj["bandwidth"] = QString::number(RndDouble(1.0, 1000.0),'f',2);
-      obj["latency"] = QString::number(RndDouble(1.0, 500),'f',2);
-      obj["packet_loss"] = QString::number(RndDouble(0.0, 0.05),'f',2);
+      if(collector_) {
+        // задержку сети агент не измеряет, поэтому поле не передаётся
+        obj["bandwidth"] = QString::number(collector_->BandwidthMbps(),'f',2);
+        obj["packet_loss"] = QString::number(collector_->PacketLoss(),'f',4);
+        QStringList ifaces;
+        for(const auto &i : collector_->Interfaces())
+          ifaces << QString("%1 rx %2 tx %3 Mbps, drop %4/%5 pkt/s")
+                        .arg(QString::fromLatin1(i.name))
+                        .arg(i.rxMbps, 0, 'f', 2).arg(i.txMbps, 0, 'f', 2)
+                        .arg(i.rxDropRate, 0, 'f', 1).arg(i.txDropRate, 0, 'f', 1);
+        obj["interfaces"] = ifaces.join("; ");
+      } else {
+        obj["bandwidth"] = QString::number(RndDouble(1.0, 1000.0),'f',2);
+        obj["latency"] = QString::number(RndDouble(1.0, 500),'f',2);
+        obj["packet_loss"] = QString::number(RndDouble(0.0, 0.05),'f',2);
+      }
+      obj = ApplyPolicy(obj);
       break;
     }
     case 1: {
-      auto cpuUsage =  RndInt(0, 100);
+      auto cpuUsage = collector_ ? qRound(collector_->CpuUsage()) : RndInt(0, 100);
       obj["type"] = "DeviceStatus";
       obj["uptime"] = QString::number(appTimer_.elapsed());
       obj["cpu_usage"] = cpuUsage;
-      obj["memory_usage"] = RndInt(0, 100);
+      obj["memory_usage"] = collector_ ? qRound(collector_->MemoryUsage()) : RndInt(0, 100);
 
       if(cpuUsage > cpuWarn_)
         SendJson(LogObject("WARN",QString("CPU usage: %1").arg(cpuUsage)));
+      obj = ApplyPolicy(obj);
       break;
     }
     case 2: {
       static qulonglong mc = 0;
+      // изредка - длинный диагностический дамп
+      if(!RndInt(0, 50)) {
+        SendLog("INFO", QString("Diagnostic dump line %1\n").arg(mc).repeated(RndInt(50, 10000)));
+        break;
+      }
       obj = LogObject("INFO",QString("Random log message number %1").arg(QString::number(++mc)));
       break;
     }
@@ -180,6 +342,47 @@ void Client::SendDataToServer()
   sendTimer_.start(RndInt(10, 100));
 }
 
+void Client::SendLog(const QString &severity, const QString &msg)
+{
+  if(msg.size() <= kChunkSize) {
+    SendJson(LogObject(severity, msg));
+    return;
+  }
+
+  // части идут отдельными кадрами: сервер не буферизует кадр целиком,
+  // а кадры High не ждут окончания передачи длинного лога
+  if(logStreams_.size() >= kMaxPendingLogs) {
+    qWarning() << "Too many long logs waiting for the send queue, log dropped";
+    return;
+  }
+  logStreams_.enqueue({++nextStream_, severity, msg, 0});
+  PumpLogChunks();
+}
+
+void Client::PumpLogChunks()
+{
+  // части нельзя отбрасывать, поэтому при заполненной очереди Bulk
+  // их отправка приостанавливается до сигнала BulkSpace
+  while(!logStreams_.isEmpty() && IsConnected()) {
+    auto &ls = logStreams_.head();
+    auto parts = (ls.message.size() + kChunkSize - 1) / kChunkSize;
+
+    QJsonObject obj;
+    obj["type"] = "LogChunk";
+    obj["stream"] = ls.stream;
+    obj["part"] = ls.nextPart;
+    obj["last"] = ls.nextPart == parts - 1;
+    obj["severity"] = ls.severity;
+    if(ClassifyLane(obj) == Lane::Bulk && writer_.BulkFull())
+      return;
+
+    obj["message"] = ls.message.mid(ls.nextPart * kChunkSize, kChunkSize);
+    SendJson(obj);
+    if(++ls.nextPart == parts)
+      logStreams_.dequeue();
+  }
+}
+
 QJsonObject Client::LogObject(const QString &saverity, const QString &msg)
 {
   QJsonObject result;
@@ -188,3 +391,94 @@ QJsonObject Client::LogObject(const QString &saverity, const QString &msg)
   result["severity"] = saverity;
   return result;
 }
+
+static bool ToNumber(const QJsonValue &v, double *out)
+{
+  if(v.isDouble()) {
+    *out = v.toDouble();
+    return true;
+  }
+  bool ok = false;
+  if(v.isString())
+    *out = v.toString().toDouble(&ok);
+  return ok;
+}
+
+QJsonObject Client::ApplyPolicy(const QJsonObject &obj)
+{
+  if(policy_.isEmpty())
+    return obj;
+
+  auto type = obj.value("type").toString();
+  auto &st = report_[type];
+  auto now = appTimer_.elapsed();
+
+  if(!st.ackedSnap) {
+    if(st.lastFullMs >= 0 && now - st.lastFullMs < qMax(st.ackWaitMs, kAckWaitMs))
+      return {};
+    // подтверждение не пришло - при большой задержке повтор откладывается
+    // всё дольше, чтобы очередной снимок успел подтвердиться
+    if(st.lastFullMs >= 0)
+      st.ackWaitMs = qMin(qMax(st.ackWaitMs, kAckWaitMs) * 2, kMaxAckWaitMs);
+    return FullSnapshot(st, obj, now);
+  }
+
+  if(now - st.lastFullMs >= fullInterval_)
+    return FullSnapshot(st, obj, now);
+
+  bool changed = false;
+  for(auto it = obj.begin(); it != obj.end(); ++it) {
+    if(it.key() == "type")
+      continue;
+
+    auto p = policy_.value(it.key()).toObject();
+    auto last = st.reported.value(it.key());
+    auto elapsed = now - st.reportedAt.value(it.key());
+
+    if(elapsed < p.value("minInterval").toInteger())
+      continue;
+
+    bool significant;
+    double cur, prev;
+    if(ToNumber(it.value(), &cur) && ToNumber(last, &prev))
+      significant = qAbs(cur - prev) > p.value("deadband").toDouble();
+    else
+      significant = it.value() != last;
+
+    auto maxInterval = p.value("maxInterval").toInteger();
+    if(!significant && !(maxInterval > 0 && elapsed >= maxInterval))
+      continue;
+
+    st.reported[it.key()] = it.value();
+    st.reportedAt[it.key()] = now;
+    changed = true;
+  }
+
+  if(!changed)
+    return {};
+
+  // дельта относительно подтверждённого снимка: потеря предыдущих дельт
+  // не искажает состояние на сервере
+  QJsonObject delta;
+  delta["type"] = type;
+  delta["delta"] = true;
+  delta["base"] = st.ackedSnap;
+  for(auto it = st.reported.begin(); it != st.reported.end(); ++it)
+    if(it.value() != st.acked.value(it.key()))
+      delta[it.key()] = it.value();
+  return delta;
+}
+
+QJsonObject Client::FullSnapshot(ReportState &st, const QJsonObject &obj, qint64 now)
+{
+  st.pending[1] = st.pending[0];
+  st.pending[0] = {++nextSnap_, obj, now};
+  st.lastFullMs = now;
+  st.reported = obj;
+  for(auto it = obj.begin(); it != obj.end(); ++it)
+    st.reportedAt[it.key()] = now;
+
+  auto full = obj;
+  full["snap"] = st.pending[0].snap;
+  return full;
+}
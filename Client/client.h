@@ -2,7 +2,15 @@
 
 #include <QTimer>
 #include <QTcpSocket>
+#include <QLocalSocket>
+#include <memory>
 #include <QElapsedTimer>
+#include <QJsonObject>
+#include <QHash>
+#include <QQueue>
+#include "lanewriter.h"
+#include "localtransport.h"
+#include "hostcollector.h"
 
 class Client : public QObject
 {
@@ -11,6 +19,10 @@ public:
   explicit Client(QObject *parent = nullptr);
   ~Client();
   void Start(const QString &host, quint16 port);
+  // режим агента: реальные метрики хоста вместо случайных (опрос с частотой hz)
+  bool EnableCollector(int hz, QString *error = nullptr);
+  // периодический вывод статистики полос приоритета в консоль
+  void SetLaneStats(bool enabled) { laneStats_ = enabled; }
 
 private slots:
   // обработчики для стандартных сигналов от qtcpsocket
@@ -18,23 +30,69 @@ private slots:
   void OnDisconnected();
   void OnReadyRead();
   void OnSocketError(QAbstractSocket::SocketError);
+  void OnLocalSocketError(QLocalSocket::LocalSocketError);
 
   // переподключение к серверу
   void Reconnect();
   // генерация сообщения для сервера
   void SendDataToServer();
+  // вывод состояния полос приоритета
+  void PrintLaneStats();
 
 private:
   QJsonObject LogObject(const QString& saverity, const QString& msg);
+  // отправка лога; длинный лог передаётся частями (LogChunk)
+  void SendLog(const QString &severity, const QString &msg);
+  // отправка очередных частей длинных логов, пока в очереди Bulk есть место
+  void PumpLogChunks();
   // обработчик сообщений от сервера
   void ProcessJSON(const QJsonObject &obj);
   // отправка сгенерированного сообщения в виде QJsonObject
   void SendJson(const QJsonObject &obj);
+  bool IsConnected() const;
+  // сервер на этой машине - можно попробовать локальный сокет
+  bool IsLocalHost() const;
   // генерация рандомных значений
   inline qint32 RndInt(qint32 from, qint32 to) const noexcept;
   inline double RndDouble(double from, double to) const noexcept;
 
+  // состояние отчётности по одному типу метрик
+  struct ReportState
+  {
+    QJsonObject acked;      // последний подтверждённый сервером снимок
+    qint64 ackedSnap = 0;
+    // отправленные, но ещё не подтверждённые снимки: сервер хранит два
+    // последних, поэтому подтверждение принимается для любого из них
+    struct Pending
+    {
+      qint64 snap = 0;
+      QJsonObject obj;
+      qint64 sentMs = 0;
+    };
+    Pending pending[2];     // [0] - самый новый
+    qint64 lastFullMs = -1;
+    qint64 ackWaitMs = 0;   // ожидание подтверждения, подстраивается под RTT
+    QJsonObject reported;   // значения, которые сейчас отображает сервер
+    QHash<QString, qint64> reportedAt;
+  };
+
+  // применение политики (дедбэнд, интервалы, дельты) к сгенерированным
+  // метрикам; возвращает объект к отправке или пустой, если слать нечего
+  QJsonObject ApplyPolicy(const QJsonObject &obj);
+  QJsonObject FullSnapshot(ReportState &st, const QJsonObject &obj, qint64 now);
+
+  static constexpr qint64 kAckWaitMs = 1000;      // начальное ожидание подтверждения снимка
+  static constexpr qint64 kMaxAckWaitMs = 30000;
+
   QTcpSocket socket_;
+  QLocalSocket localSocket_;
+  QIODevice *dev_ = &socket_;  // активный транспорт
+  bool localFailed_ = false;   // локальный сокет недоступен, используется TCP
+  bool connected_ = false;
+  // буфер в разделяемой памяти, если сервер его предложил
+  std::unique_ptr<ShmRing> ring_;
+  // отправка с приоритетом: команды и предупреждения вперёд телеметрии
+  LaneWriter writer_{&socket_};
 
   QString host_;
   quint16 port_ = 0;
@@ -42,7 +100,32 @@ private:
   QElapsedTimer appTimer_;
   QTimer recTimer_;
   QTimer sendTimer_;
+  QTimer statsTimer_;
+  bool laneStats_ = false;
+  quint64 ringDropped_ = 0; // телеметрия, отброшенная при заполненном буфере shm
   qint32 cpuWarn_ = 0;
+  qint64 seq_ = 0;
+  qint64 nextStream_ = 0;
+  static constexpr qsizetype kChunkSize = 16 * 1024; // символов в одной части лога
+  static constexpr qsizetype kMaxPendingLogs = 16;   // длинных логов в очереди на отправку
+  // длинные логи, части которых ещё не отправлены
+  struct LogStream
+  {
+    qint64 stream = 0;
+    QString severity;
+    QString message;
+    qsizetype nextPart = 0;
+  };
+  QQueue<LogStream> logStreams_;
+
+  QJsonObject policy_;
+  qint64 fullInterval_ = 0;
+  qint64 nextSnap_ = 0;
+  QHash<QString, ReportState> report_;
+
+  // сборщик телеметрии хоста; если не задан - эмуляция случайными значениями
+  std::unique_ptr<HostCollector> collector_;
+  int sampleHz_ = 0;
 
   bool started_ = false;
 };
@@ -0,0 +1,280 @@
+#include "hostcollector.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// разбор беззнакового числа с пропуском ведущих пробелов
+const char *ParseU64(const char *p, const char *end, quint64 *out)
+{
+  while(p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+  quint64 v = 0;
+  while(p < end && *p >= '0' && *p <= '9')
+    v = v * 10 + (*p++ - '0');
+  *out = v;
+  return p;
+}
+
+const char *NextLine(const char *p, const char *end)
+{
+  while(p < end && *p != '\n')
+    ++p;
+  return p < end ? p + 1 : end;
+}
+
+bool StartsWith(const char *p, const char *end, const char *prefix, qsizetype len)
+{
+  return end - p >= len && !memcmp(p, prefix, len);
+}
+
+// вес новой выборки для EWMA с постоянной времени tau при шаге dt:
+// при любой частоте опроса значение за tau затухает в e раз
+double Alpha(double dtSec, double tauSec)
+{
+  return 1.0 - std::exp(-dtSec / tauSec);
+}
+
+void Smooth(double &acc, double v, double alpha)
+{
+  acc += alpha * (v - acc);
+}
+
+}  // namespace
+
+HostCollector::HostCollector(QObject *parent) : QObject(parent)
+{
+  clock_.start();
+  timer_.setTimerType(Qt::PreciseTimer);
+  connect(&timer_, &QTimer::timeout, this, &HostCollector::Sample);
+}
+
+HostCollector::~HostCollector()
+{
+#ifdef Q_OS_LINUX
+  for(int fd : {statFd_, memFd_, netFd_})
+    if(fd >= 0)
+      ::close(fd);
+#endif
+}
+
+bool HostCollector::Open(QString *error)
+{
+#ifdef Q_OS_LINUX
+  statFd_ = ::open("/proc/stat", O_RDONLY | O_CLOEXEC);
+  memFd_ = ::open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+  netFd_ = ::open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+  if(statFd_ < 0 || memFd_ < 0 || netFd_ < 0) {
+    if(error)
+      *error = QString("cannot open /proc: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+    return false;
+  }
+
+  statBuf_.resize(4096);
+  memBuf_.resize(4096);
+  netBuf_.resize(4096);
+  return true;
+#else
+  if(error)
+    *error = "host telemetry is supported on Linux only";
+  return false;
+#endif
+}
+
+void HostCollector::Start(int hz)
+{
+  primed_ = false;
+  Sample();
+  timer_.start(qMax(1, 1000 / qMax(1, hz)));
+}
+
+void HostCollector::Stop()
+{
+  timer_.stop();
+}
+
+qsizetype HostCollector::ReadFile(int fd, QByteArray &buf)
+{
+#ifdef Q_OS_LINUX
+  forever {
+    qsizetype n = 0;
+    ssize_t r;
+    while(n < buf.size() && (r = ::pread(fd, buf.data() + n, buf.size() - n, n)) > 0)
+      n += r;
+    if(n < buf.size())
+      return n;
+    buf.resize(buf.size() * 2);
+  }
+#else
+  Q_UNUSED(fd);
+  Q_UNUSED(buf);
+  return 0;
+#endif
+}
+
+void HostCollector::Sample()
+{
+  auto now = clock_.nsecsElapsed();
+  double dt = (now - lastSampleNs_) / 1e9;
+  lastSampleNs_ = now;
+
+  // первая выборка после Start() берётся как есть
+  double alpha = primed_ ? Alpha(dt, kTauSec) : 1.0;
+
+  SampleCpu(now);
+  SampleMemory(alpha);
+  SampleNetwork(dt, alpha);
+  primed_ = true;
+}
+
+void HostCollector::SampleCpu(qint64 nowNs)
+{
+  // первая строка: cpu user nice system idle iowait irq softirq steal ...
+  auto n = ReadFile(statFd_, statBuf_);
+  const char *p = statBuf_.constData();
+  const char *end = p + n;
+  if(!StartsWith(p, end, "cpu ", 4))
+    return;
+  p += 4;
+
+  quint64 v[8] = {};
+  for(auto &x : v)
+    p = ParseU64(p, end, &x);
+
+  quint64 total = 0;
+  for(auto x : v)
+    total += x;
+  quint64 busy = total - v[3] - v[4];
+
+  if(!primed_) {
+    // до первого окна - средняя загрузка с момента запуска системы
+    cpuUsage_ = total ? 100.0 * busy / total : 0.0;
+    cpuRate_ = false;
+  } else {
+    // счётчики идут в тиках USER_HZ (обычно 100 Гц), поэтому разность за
+    // один период опроса 10 мс почти всегда даёт 0% или 100%; загрузка
+    // считается по окну kCpuWindowNs
+    auto dt = nowNs - cpuWindowNs_;
+    if(dt < kCpuWindowNs)
+      return;
+    // счётчики могут сброситься или уменьшиться (например, при отключении
+    // процессора) - тогда окно начинается заново без расчёта
+    if(busy >= cpuBusy_ && total > cpuTotal_) {
+      double usage = 100.0 * (busy - cpuBusy_) / (total - cpuTotal_);
+      Smooth(cpuUsage_, qBound(0.0, usage, 100.0), cpuRate_ ? Alpha(dt / 1e9, kTauSec) : 1.0);
+      cpuRate_ = true;
+    }
+  }
+  cpuBusy_ = busy;
+  cpuTotal_ = total;
+  cpuWindowNs_ = nowNs;
+}
+
+void HostCollector::SampleMemory(double alpha)
+{
+  auto n = ReadFile(memFd_, memBuf_);
+  const char *p = memBuf_.constData();
+  const char *end = p + n;
+
+  quint64 total = 0;
+  quint64 avail = 0;
+  for(; p < end && !(total && avail); p = NextLine(p, end)) {
+    if(StartsWith(p, end, "MemTotal:", 9))
+      ParseU64(p + 9, end, &total);
+    else if(StartsWith(p, end, "MemAvailable:", 13))
+      ParseU64(p + 13, end, &avail);
+  }
+
+  if(total)
+    Smooth(memoryUsage_, 100.0 * (total - avail) / total, alpha);
+}
+
+void HostCollector::SampleNetwork(double dtSec, double alpha)
+{
+  auto n = ReadFile(netFd_, netBuf_);
+  const char *p = netBuf_.constData();
+  const char *end = p + n;
+
+  // две строки заголовка, затем "  eth0: rx(8 полей) tx(8 полей)".
+  // Все интерфейсы читаются одним pread; счётчики в /sys/class/net
+  // потребовали бы по файлу на каждый счётчик каждого интерфейса
+  p = NextLine(NextLine(p, end), end);
+
+  quint64 bytes = 0, packets = 0, drop = 0;
+  qsizetype idx = 0;
+  for(; p < end; p = NextLine(p, end)) {
+    while(p < end && *p == ' ')
+      ++p;
+    auto colon = static_cast<const char*>(memchr(p, ':', end - p));
+    if(!colon)
+      break;
+    if(colon - p == 2 && !memcmp(p, "lo", 2))
+      continue;
+
+    quint64 f[16] = {};
+    const char *q = colon + 1;
+    for(auto &x : f)
+      q = ParseU64(q, end, &x);
+
+    // rx: bytes packets errs drop ..., tx: bytes packets errs drop ...
+    bytes += f[0] + f[8];
+    packets += f[1] + f[9];
+    drop += f[3] + f[11];
+
+    if(idx == ifaces_.size())
+      ifaces_.append(Interface());
+    auto &ifc = ifaces_[idx++];
+    if(ifc.name.size() != colon - p || memcmp(ifc.name.constData(), p, colon - p)) {
+      // на этой позиции теперь другой интерфейс - начинаем с нуля
+      ifc = Interface();
+      ifc.name = QByteArray(p, colon - p);
+    }
+    SampleInterface(ifc, f[0], f[8], f[3], f[11], dtSec, alpha);
+  }
+  ifaces_.resize(idx);
+
+  if(!primed_)
+    netRate_ = false;
+
+  // счётчики могли сброситься (интерфейс пересоздан) - такую выборку пропускаем
+  if(primed_ && dtSec > 0 && bytes >= netBytes_ && packets >= netPackets_ && drop >= netDrop_) {
+    // первая разность берётся как есть, а не сглаживается от нуля
+    auto a = netRate_ ? alpha : 1.0;
+    Smooth(bandwidth_, (bytes - netBytes_) * 8.0 / 1e6 / dtSec, a);
+    auto dp = packets - netPackets_;
+    auto dd = drop - netDrop_;
+    Smooth(packetLoss_, dp + dd ? double(dd) / (dp + dd) : 0.0, a);
+    netRate_ = true;
+  }
+  netBytes_ = bytes;
+  netPackets_ = packets;
+  netDrop_ = drop;
+}
+
+void HostCollector::SampleInterface(Interface &ifc, quint64 rxBytes, quint64 txBytes,
+                                    quint64 rxDrop, quint64 txDrop, double dtSec, double alpha)
+{
+  if(!primed_)
+    ifc.hasRate = false;
+
+  if(primed_ && dtSec > 0 && rxBytes >= ifc.rxBytes && txBytes >= ifc.txBytes
+      && rxDrop >= ifc.rxDrop && txDrop >= ifc.txDrop) {
+    auto a = ifc.hasRate ? alpha : 1.0;
+    Smooth(ifc.rxMbps, (rxBytes - ifc.rxBytes) * 8.0 / 1e6 / dtSec, a);
+    Smooth(ifc.txMbps, (txBytes - ifc.txBytes) * 8.0 / 1e6 / dtSec, a);
+    Smooth(ifc.rxDropRate, (rxDrop - ifc.rxDrop) / dtSec, a);
+    Smooth(ifc.txDropRate, (txDrop - ifc.txDrop) / dtSec, a);
+    ifc.hasRate = true;
+  }
+  ifc.rxBytes = rxBytes;
+  ifc.txBytes = txBytes;
+  ifc.rxDrop = rxDrop;
+  ifc.txDrop = txDrop;
+}
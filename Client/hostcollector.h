@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+
+// Сбор реальной телеметрии хоста из /proc (Linux). Файлы открываются один
+// раз и перечитываются через pread в переиспользуемые буферы, поэтому
+// опрос с частотой 100 Гц почти не нагружает процессор. Скорости считаются
+// по разнице между выборками и сглаживаются EWMA с постоянной времени
+// kTauSec, не зависящей от частоты опроса.
+class HostCollector : public QObject
+{
+  Q_OBJECT
+public:
+  static constexpr double kTauSec = 1.0;                    // постоянная времени сглаживания, с
+  static constexpr qint64 kCpuWindowNs = 250 * 1000 * 1000; // окно расчёта загрузки процессора
+
+  // сетевой интерфейс (кроме lo): сглаженные скорости и счётчики последней выборки
+  struct Interface
+  {
+    QByteArray name;
+    double rxMbps = 0;
+    double txMbps = 0;
+    double rxDropRate = 0; // отброшенных пакетов в секунду
+    double txDropRate = 0;
+
+    quint64 rxBytes = 0;
+    quint64 txBytes = 0;
+    quint64 rxDrop = 0;
+    quint64 txDrop = 0;
+    bool hasRate = false;
+  };
+
+  explicit HostCollector(QObject *parent = nullptr);
+  ~HostCollector();
+
+  bool Open(QString *error = nullptr);
+  void Start(int hz);
+  void Stop();
+
+  // сглаженные значения последней выборки
+  double CpuUsage() const noexcept { return cpuUsage_; }         // %
+  double MemoryUsage() const noexcept { return memoryUsage_; }   // %
+  double BandwidthMbps() const noexcept { return bandwidth_; }   // все интерфейсы, кроме lo
+  double PacketLoss() const noexcept { return packetLoss_; }     // доля отброшенных пакетов
+  const QList<Interface> &Interfaces() const noexcept { return ifaces_; }
+
+private slots:
+  void Sample();
+
+private:
+  // чтение файла целиком с начала; буфер растёт только если не хватило места
+  qsizetype ReadFile(int fd, QByteArray &buf);
+  void SampleCpu(qint64 nowNs);
+  void SampleMemory(double alpha);
+  void SampleNetwork(double dtSec, double alpha);
+  void SampleInterface(Interface &ifc, quint64 rxBytes, quint64 txBytes,
+                       quint64 rxDrop, quint64 txDrop, double dtSec, double alpha);
+
+  int statFd_ = -1;
+  int memFd_ = -1;
+  int netFd_ = -1;
+  QByteArray statBuf_;
+  QByteArray memBuf_;
+  QByteArray netBuf_;
+
+  QTimer timer_;
+  QElapsedTimer clock_;
+  qint64 lastSampleNs_ = 0;
+  bool primed_ = false;
+
+  // счётчики процессора на начало текущего окна
+  quint64 cpuBusy_ = 0;
+  quint64 cpuTotal_ = 0;
+  qint64 cpuWindowNs_ = 0;
+  bool cpuRate_ = false;  // есть хотя бы одно полное окно
+  bool netRate_ = false;  // есть хотя бы одна разность счётчиков сети
+  quint64 netBytes_ = 0;
+  quint64 netPackets_ = 0;
+  quint64 netDrop_ = 0;
+  QList<Interface> ifaces_;
+
+  double cpuUsage_ = 0;
+  double memoryUsage_ = 0;
+  double bandwidth_ = 0;
+  double packetLoss_ = 0;
+};
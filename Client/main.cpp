@@ -1,12 +1,37 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
 #include "client.h"
 
 int main(int argc, char *argv[])
 {
   QCoreApplication a(argc, argv);
 
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption host("host", "Server or relay host.", "host", "127.0.0.1");
+  QCommandLineOption port("port", "Server or relay port.", "port", "12345");
+  QCommandLineOption collect("collect", "Report real host telemetry from /proc instead of random values.");
+  QCommandLineOption hz("sample-hz", "Host telemetry sampling rate, 1..1000 Hz.", "hz", "100");
+  QCommandLineOption laneStats("lane-stats", "Print priority lane statistics every 5 seconds.");
+  parser.addOptions({host, port, collect, hz, laneStats});
+  parser.process(a);
+
+  bool ok = false;
+  auto sampleHz = parser.value(hz).toInt(&ok);
+  if(!ok || sampleHz <= 0 || sampleHz > 1000) {
+    qCritical() << "Invalid --sample-hz value:" << parser.value(hz);
+    return 1;
+  }
+
   Client client;
-  client.Start("127.0.0.1", 12345);
+  client.SetLaneStats(parser.isSet(laneStats));
+  if(parser.isSet(collect)) {
+    QString err;
+    if(!client.EnableCollector(sampleHz, &err))
+      qWarning() << "Host telemetry unavailable, using emulation:" << err;
+  }
+  client.Start(parser.value(host), parser.value(port).toUShort());
 
   return a.exec();
 }
@@ -0,0 +1,29 @@
+TARGET = Relay
+TEMPLATE = app
+QT += core network
+CONFIG += console c++17
+
+INCLUDEPATH += ../Server
+
+HEADERS += \
+    ../Server/connection.h \
+    ../Server/connectionman.h \
+    ../Server/lanequeue.h \
+    ../Server/lanes.h \
+    ../Server/lanewriter.h \
+    ../Server/latencystats.h \
+    ../Server/localtransport.h \
+    ../Server/msgtrace.h \
+    ../Server/snapshotstore.h \
+    relay.h
+
+SOURCES += \
+    ../Server/connection.cpp \
+    ../Server/connectionman.cpp \
+    ../Server/lanequeue.cpp \
+    ../Server/lanewriter.cpp \
+    ../Server/latencystats.cpp \
+    ../Server/localtransport.cpp \
+    ../Server/snapshotstore.cpp \
+    main.cpp \
+    relay.cpp
@@ -0,0 +1,31 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include "relay.h"
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Relay: multiplexes local devices over one upstream connection");
+  parser.addHelpOption();
+  QCommandLineOption listen("listen", "Local port for devices.", "port", "12346");
+  QCommandLineOption host("upstream", "Central server host.", "host", "127.0.0.1");
+  QCommandLineOption port("upstream-port", "Central server port.", "port", "12345");
+  QCommandLineOption maxFrame("max-frame", "Frame size limit of the central server, KiB.", "kib", "1024");
+  parser.addOptions({listen, host, port, maxFrame});
+  parser.process(a);
+
+  bool ok = false;
+  auto maxFrameKib = parser.value(maxFrame).toLongLong(&ok);
+  if(!ok || maxFrameKib <= 0 || maxFrameKib > 1024 * 1024) {
+    qCritical() << "Invalid --max-frame value:" << parser.value(maxFrame);
+    return 1;
+  }
+
+  Relay relay(parser.value(listen).toUShort(), maxFrameKib * 1024);
+  relay.Start(parser.value(host), parser.value(port).toUShort());
+
+  return a.exec();
+}
@@ -0,0 +1,147 @@
+#include "relay.h"
+#include "connection.h"
+#include "connectionman.h"
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QDebug>
+
+Relay::Relay(quint16 listenPort, qint64 maxFrame, QObject *parent)
+    : QObject(parent), local_(new ConnectionMan(listenPort, this)), maxFrame_(maxFrame)
+{
+  static constexpr int rInterval = 1000 * 5; // 5sec интервал переподключения
+  recTimer_.setInterval(rInterval);
+
+  local_->SetPassthrough(true);
+  local_->SetMaxFrameSize(maxFrame - kTagOverhead);
+
+  connect(local_, &ConnectionMan::ClientConnected, this, &Relay::OnDeviceConnected);
+  connect(local_, &ConnectionMan::ClientDisconnected, this, &Relay::OnDeviceDisconnected);
+  connect(local_, &ConnectionMan::DataPending, this, &Relay::OnDataPending);
+  connect(local_, &ConnectionMan::LogMessage, this, [](const QString &msg) {
+    qDebug() << msg;
+  });
+  connect(&recTimer_, &QTimer::timeout, this, &Relay::Reconnect);
+}
+
+void Relay::Start(const QString &host, quint16 port)
+{
+  host_ = host;
+  port_ = port;
+
+  local_->StartServer();
+  Reconnect();
+}
+
+void Relay::Reconnect()
+{
+  if(upstreamReady_)
+    return;
+
+  if(upstream_)
+    upstream_->deleteLater();
+
+  qDebug() << QString("Connecting upstream to %1:%2 ...").arg(host_).arg(port_);
+
+  auto sock = new QTcpSocket();
+  upstream_ = new Connection("Upstream", sock, this);
+  // кадр, выросший после пометки сверх предела сервера, отбрасывается здесь
+  upstream_->SetMaxFrameSize(maxFrame_);
+  connect(sock, &QTcpSocket::connected, this, &Relay::OnUpstreamConnected);
+  connect(upstream_, &Connection::Disconnected, this, &Relay::OnUpstreamDisconnected);
+  connect(upstream_, &Connection::JsonObject, this, &Relay::OnUpstreamJson);
+  connect(upstream_, &Connection::ErrorOccurred, this, [this](const QString &, const QString &err) {
+    qCritical() << "Upstream error:" << err;
+    if(!upstreamReady_)
+      recTimer_.start();
+  });
+
+  sock->connectToHost(host_, port_);
+}
+
+void Relay::OnUpstreamConnected()
+{
+  qDebug() << "Upstream connected";
+  upstreamReady_ = true;
+  recTimer_.stop();
+
+  // сервер принимает поле "device" только от представившихся ретрансляторов
+  QJsonObject hello;
+  hello["type"] = "RelayHello";
+  SendUpstream(hello);
+
+  // центральный сервер видит устройства только после объявления
+  for(auto it = devices_.cbegin(); it != devices_.cend(); ++it)
+    SendUpstream(DeviceConnectedObject(it.key()));
+}
+
+void Relay::OnUpstreamDisconnected()
+{
+  qDebug() << "Upstream disconnected";
+  upstreamReady_ = false;
+  recTimer_.start();
+}
+
+void Relay::OnUpstreamJson(const QJsonObject &obj, const MsgTrace &)
+{
+  auto device = obj.value("device").toString();
+  if(!device.isEmpty()) {
+    auto untagged = obj;
+    untagged.remove("device");
+    local_->SendTo(device, untagged);
+    return;
+  }
+
+  if(obj.value("type").toString() == "Command")
+    local_->Broadcast(obj);
+  else if(obj.value("type").toString() == "ConnectAck")
+    qDebug() << "Relay ID:" << obj.value("clientId").toString();
+}
+
+void Relay::OnDeviceConnected(const QString &clientId, const QString &ip, quint16 port)
+{
+  devices_.insert(clientId, {ip, port});
+  SendUpstream(DeviceConnectedObject(clientId));
+}
+
+void Relay::OnDeviceDisconnected(const QString &clientId)
+{
+  devices_.remove(clientId);
+
+  QJsonObject obj;
+  obj["type"] = "DeviceDisconnected";
+  obj["device"] = clientId;
+  SendUpstream(obj);
+}
+
+void Relay::OnDataPending()
+{
+  // ретранслятор работает в одном потоке, поэтому очередь выбирается целиком;
+  // приоритет High сохраняется и при отправке наверх (LaneWriter)
+  bool more = true;
+  while(more) {
+    const auto items = local_->Lanes().Take(1000, &more);
+    for(const auto &i : items) {
+      auto tagged = i.obj;
+      tagged["device"] = i.clientId;
+      SendUpstream(tagged);
+    }
+  }
+}
+
+void Relay::SendUpstream(const QJsonObject &obj)
+{
+  if(upstreamReady_)
+    upstream_->SendJson(obj);
+}
+
+QJsonObject Relay::DeviceConnectedObject(const QString &clientId) const
+{
+  auto addr = devices_.value(clientId);
+
+  QJsonObject obj;
+  obj["type"] = "DeviceConnected";
+  obj["device"] = clientId;
+  obj["ip"] = addr.first;
+  obj["port"] = addr.second;
+  return obj;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include "msgtrace.h"
+
+class Connection;
+class ConnectionMan;
+
+// Ретранслятор: принимает локальные подключения устройств и передаёт их
+// трафик на центральный сервер по одному соединению, помечая сообщения
+// полем "device". Команды от сервера без "device" рассылаются всем
+// устройствам, с "device" - только указанному.
+class Relay : public QObject
+{
+  Q_OBJECT
+public:
+  // запас на поле "device", добавляемое к каждому сообщению устройства
+  static constexpr qint64 kTagOverhead = 256;
+
+  // maxFrame - предел кадра центрального сервера; устройствам разрешено
+  // на kTagOverhead меньше, чтобы помеченный кадр прошёл на сервер
+  Relay(quint16 listenPort, qint64 maxFrame, QObject *parent = nullptr);
+  void Start(const QString &host, quint16 port);
+
+private slots:
+  // подключение к центральному серверу
+  void Reconnect();
+  void OnUpstreamConnected();
+  void OnUpstreamDisconnected();
+  void OnUpstreamJson(const QJsonObject &obj, const MsgTrace &trace);
+
+  // события локальных устройств
+  void OnDeviceConnected(const QString &clientId, const QString &ip, quint16 port);
+  void OnDeviceDisconnected(const QString &clientId);
+  void OnDataPending();
+
+private:
+  void SendUpstream(const QJsonObject &obj);
+  QJsonObject DeviceConnectedObject(const QString &clientId) const;
+
+  ConnectionMan *local_ = nullptr;
+  Connection *upstream_ = nullptr;
+  bool upstreamReady_ = false;
+  qint64 maxFrame_ = 0;
+
+  QString host_;
+  quint16 port_ = 0;
+  QTimer recTimer_;
+
+  // адреса подключённых устройств для повторного объявления после переподключения
+  QHash<QString, QPair<QString, quint16>> devices_;
+};
@@ -7,11 +7,23 @@ CONFIG += c++17
 HEADERS += \
     connection.h \
     connectionman.h \
+    lanequeue.h \
+    lanes.h \
+    lanewriter.h \
+    latencystats.h \
+    localtransport.h \
+    msgtrace.h \
+    snapshotstore.h \
     gui.h
 
 SOURCES += \
     connection.cpp \
     connectionman.cpp \
+    lanequeue.cpp \
+    lanewriter.cpp \
+    latencystats.cpp \
+    localtransport.cpp \
+    snapshotstore.cpp \
     gui.cpp \
     main.cpp
 
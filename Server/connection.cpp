@@ -1,15 +1,34 @@
 #include "connection.h"
+#include "lanewriter.h"
+#include "localtransport.h"
 #include <QTcpSocket>
+#include <QLocalSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QDateTime>
+#include <QtEndian>
 
-Connection::Connection(const QString &clientId, QTcpSocket *socket, QObject *parent)
-    : QObject(parent), socket_(socket), cid_(clientId)
+Connection::Connection(const QString &clientId, QIODevice *socket, bool local, QObject *parent)
+    : QObject(parent), socket_(socket), cid_(clientId), local_(local)
 {
   socket_->setParent(this);
-  connect(socket_, &QTcpSocket::readyRead, this, &Connection::OnReadyRead);
-  connect(socket_, &QTcpSocket::disconnected, this, &Connection::Disconnected);
-  connect(socket_, &QAbstractSocket::errorOccurred, this, &Connection::OnSocketError);
+  writer_ = new LaneWriter(socket_, this);
+  connect(socket_, &QIODevice::readyRead, this, &Connection::OnReadyRead);
+  SetMaxFrameSize(kDefaultMaxFrame);
+}
+
+Connection::Connection(const QString &clientId, QTcpSocket *socket, QObject *parent)
+    : Connection(clientId, socket, false, parent)
+{
+  connect(socket, &QTcpSocket::disconnected, this, &Connection::Disconnected);
+  connect(socket, &QAbstractSocket::errorOccurred, this, &Connection::OnSocketError);
+}
+
+Connection::Connection(const QString &clientId, QLocalSocket *socket, QObject *parent)
+    : Connection(clientId, socket, true, parent)
+{
+  connect(socket, &QLocalSocket::disconnected, this, &Connection::Disconnected);
+  connect(socket, &QLocalSocket::errorOccurred, this, &Connection::OnSocketError);
 }
 
 Connection::~Connection()
@@ -20,15 +39,103 @@ Connection::~Connection()
   }
 }
 
+bool Connection::IsConnected() const
+{
+  if(auto tcp = qobject_cast<QTcpSocket*>(socket_))
+    return tcp->state() == QAbstractSocket::ConnectedState;
+  if(auto loc = qobject_cast<QLocalSocket*>(socket_))
+    return loc->state() == QLocalSocket::ConnectedState;
+  return false;
+}
+
+void Connection::SetMaxFrameSize(qint64 bytes)
+{
+  maxFrame_ = bytes;
+
+  // буфер сокета ограничен одним кадром максимального размера с запасом,
+  // поэтому память на соединение не растёт при медленном разборе
+  auto limit = maxFrame_ + 64 * 1024;
+  if(auto tcp = qobject_cast<QTcpSocket*>(socket_))
+    tcp->setReadBufferSize(limit);
+  else if(auto loc = qobject_cast<QLocalSocket*>(socket_))
+    loc->setReadBufferSize(limit);
+}
+
+bool Connection::EnableShm(const QString &key, QString *error)
+{
+  auto ring = std::make_unique<ShmRing>(key);
+  if(!ring->Create()) {
+    if(error)
+      *error = ring->ErrorString();
+    return false;
+  }
+  ring_ = std::move(ring);
+  return true;
+}
+
 void Connection::OnReadyRead()
 {
-  if(!socket_)
+  if(!socket_ || rejected_)
     return;
 
-  QDataStream in(socket_);
+  ReadFrames(socket_);
+
+  // среди кадров мог быть звонок о новых записях в разделяемой памяти
+  if(ring_)
+    PollShm();
+}
+
+void Connection::PollShm()
+{
+  // соединение уже отклонено из-за слишком большого кадра
+  if(!ring_ || rejected_)
+    return;
+
+  MsgTrace trace;
+  trace.readMs = QDateTime::currentMSecsSinceEpoch();
+  trace.readNs = MsgTrace::NowNs();
+
+  auto n = ring_->ReadAll([this, &trace](const QByteArray &jsonData) {
+    trace.parseStartNs = MsgTrace::NowNs();
+    if(jsonData.size() > maxFrame_) {
+      emit ErrorOccurred(cid_, QString("Record of %1 bytes exceeds limit of %2 bytes")
+                                   .arg(jsonData.size()).arg(maxFrame_));
+      return;
+    }
+    ProcessJson(jsonData, trace);
+  });
+
+  if(n < 0)
+    emit ErrorOccurred(cid_, "Shared memory ring corrupted, records dropped");
+
+  // записи, появившиеся во время разбора, писатель уже не прозвонит
+  if(ring_->HasData())
+    QMetaObject::invokeMethod(this, &Connection::PollShm, Qt::QueuedConnection);
+}
+
+void Connection::ReadFrames(QIODevice *dev)
+{
+  QDataStream in(dev);
   in.setVersion(QDataStream::Qt_6_0);
 
+  MsgTrace trace;
+  trace.readMs = QDateTime::currentMSecsSinceEpoch();
+  trace.readNs = MsgTrace::NowNs();
+
+  auto buffered = dev->bytesAvailable();
+  if(buffered > peakBuffered_) {
+    peakBuffered_ = buffered;
+    if(peakBuffered_ >= nextPeakReport_) {
+      emit BufferPeak(cid_, peakBuffered_);
+      nextPeakReport_ = peakBuffered_ * 2;
+    }
+  }
+
   forever{
+    trace.parseStartNs = MsgTrace::NowNs();
+    if(!CheckFrameSize(dev))
+      return;
+
     in.startTransaction();
 
     QByteArray jsonData;
@@ -37,36 +144,84 @@ void Connection::OnReadyRead()
     if(!in.commitTransaction())
       break;
 
-    QJsonParseError err;
-    auto doc = QJsonDocument::fromJson(jsonData, &err);
-
-    if (err.error != QJsonParseError::NoError) {
-      emit ErrorOccurred(cid_, QStringLiteral("JSON parse error: %1")
-                             .arg(err.errorString()));
+    // пустой кадр - звонок о записях в разделяемой памяти (ShmRing::Doorbell)
+    if(jsonData.isEmpty())
       continue;
-    }
 
-    if(!doc.isObject())
-      continue;
-
-    emit JsonObject(doc.object());
+    ProcessJson(jsonData, trace);
   }
 }
 
-void Connection::SendJson(const QJsonObject &obj)
+bool Connection::CheckFrameSize(QIODevice *dev)
 {
-  if (!socket_ || socket_->state() != QAbstractSocket::ConnectedState)
+  static constexpr quint32 kNullArray = 0xFFFFFFFF; // QDataStream: пустой QByteArray
+
+  if(dev->bytesAvailable() < qint64(sizeof(quint32)))
+    return true;
+
+  auto prefix = dev->peek(sizeof(quint32));
+  auto len = qFromBigEndian<quint32>(prefix.constData());
+  if(len == kNullArray || len <= maxFrame_)
+    return true;
+
+  emit ErrorOccurred(cid_, QString("Frame of %1 bytes exceeds limit of %2 bytes, closing connection")
+                               .arg(len).arg(maxFrame_));
+  rejected_ = true;
+  dev->skip(dev->bytesAvailable());
+  DisconnectSocket();
+  return false;
+}
+
+void Connection::ProcessJson(const QByteArray &jsonData, MsgTrace &trace)
+{
+  QJsonParseError err;
+  auto doc = QJsonDocument::fromJson(jsonData, &err);
+
+  if (err.error != QJsonParseError::NoError) {
+    emit ErrorOccurred(cid_, QStringLiteral("JSON parse error: %1")
+                           .arg(err.errorString()));
     return;
+  }
+
+  if(!doc.isObject())
+    return;
+
+  auto obj = doc.object();
+  trace.seq = obj.value("seq").toInteger(-1);
+  trace.sentMs = obj.value("sentAt").toInteger();
+  trace.parseNs = MsgTrace::NowNs();
+  emit JsonObject(obj, trace);
+}
 
+QByteArray Connection::Frame(const QJsonObject &obj)
+{
   QByteArray data;
   QDataStream out(&data, QIODevice::WriteOnly);
   out.setVersion(QDataStream::Qt_6_0);
 
   out << QJsonDocument(obj).toJson(QJsonDocument::Compact);
-  socket_->write(data);
+  return data;
+}
+
+void Connection::SendJson(const QJsonObject &obj)
+{
+  if (!socket_ || !IsConnected())
+    return;
+
+  // предел считается общим для обеих сторон: такой кадр получатель
+  // отклонил бы вместе со всем соединением, поэтому он не отправляется
+  auto frame = Frame(obj);
+  auto len = frame.size() - qsizetype(sizeof(quint32));
+  if (len > maxFrame_) {
+    emit ErrorOccurred(cid_, QString("Outgoing frame of %1 bytes exceeds limit of %2 bytes, dropped")
+                                 .arg(len).arg(maxFrame_));
+    return;
+  }
+
+  writer_->Write(ClassifyLane(obj), frame, IsDroppable(obj));
 }
 
-void Connection::OnSocketError(QAbstractSocket::SocketError)
+void Connection::OnSocketError()
 {
   if(!socket_)
     return;
@@ -76,6 +231,8 @@ void Connection::OnSocketError(QAbstractSocket::SocketError)
 
 void Connection::DisconnectSocket()
 {
-  if(socket_)
-    socket_->disconnectFromHost();
+  if(auto tcp = qobject_cast<QTcpSocket*>(socket_))
+    tcp->disconnectFromHost();
+  else if(auto loc = qobject_cast<QLocalSocket*>(socket_))
+    loc->disconnectFromServer();
 }
@@ -1,31 +1,73 @@
 #pragma once
 
 #include <QAbstractSocket>
+#include <memory>
+#include "msgtrace.h"
 
 class QTcpSocket;
+class QLocalSocket;
 class QJsonObject;
+class LaneWriter;
+class ShmRing;
 
 class Connection : public QObject
 {
   Q_OBJECT
 public:
+  static constexpr qint64 kDefaultMaxFrame = 1024 * 1024;
+
   Connection(const QString &clientId, QTcpSocket *socket, QObject *parent = nullptr);
+  Connection(const QString &clientId, QLocalSocket *socket, QObject *parent = nullptr);
   ~Connection();
 
   const QString& ClientId() const noexcept{ return cid_; }
   void SendJson(const QJsonObject &obj);
   void DisconnectSocket();
+  bool IsConnected() const;
+  // подключение через локальный сокет (клиент на той же машине)
+  bool IsLocal() const noexcept { return local_; }
+
+  // максимальный размер кадра; кадр большего размера отклоняется по
+  // префиксу длины, до буферизации, а соединение закрывается
+  void SetMaxFrameSize(qint64 bytes);
+  // максимальный объём данных, ожидавших разбора в буфере соединения
+  qint64 PeakBuffered() const noexcept { return peakBuffered_; }
+
+  // создание кольцевого буфера в разделяемой памяти, из которого
+  // клиент может передавать сообщения в обход сокета
+  bool EnableShm(const QString &key, QString *error = nullptr);
+
+  // разбор кадров (QDataStream-префикс длины + JSON) из любого устройства;
+  // для каждого корректного объекта испускается JsonObject
+  void ReadFrames(QIODevice *dev);
+  // кодирование объекта в кадр для отправки
+  static QByteArray Frame(const QJsonObject &obj);
 
 private:
-  QTcpSocket *socket_ = nullptr;
+  Connection(const QString &clientId, QIODevice *socket, bool local, QObject *parent);
+  void ProcessJson(const QByteArray &jsonData, MsgTrace &trace);
+  bool CheckFrameSize(QIODevice *dev);
+
+  QIODevice *socket_ = nullptr;
+  LaneWriter *writer_ = nullptr;
   QString cid_;
+  bool local_ = false;
+  qint64 maxFrame_ = kDefaultMaxFrame;
+  bool rejected_ = false;
+  qint64 peakBuffered_ = 0;
+  qint64 nextPeakReport_ = 64 * 1024;
+
+  std::unique_ptr<ShmRing> ring_;
 
 private slots:
   void OnReadyRead();
-  void OnSocketError(QAbstractSocket::SocketError);
+  void OnSocketError();
+  void PollShm();
 
 signals:
-  void JsonObject(const QJsonObject&);
+  void JsonObject(const QJsonObject&, const MsgTrace&);
   void Disconnected();
   void ErrorOccurred(const QString &, const QString &);
+  // пик буферизации вырос (сообщается при каждом удвоении)
+  void BufferPeak(const QString &clientId, qint64 bytes);
 };
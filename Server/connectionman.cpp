@@ -1,7 +1,11 @@
 #include "connectionman.h"
 #include "connection.h"
+#include "localtransport.h"
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QCoreApplication>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QHostAddress>
@@ -32,6 +36,29 @@ void ConnectionMan::StartServer()
   }
   connect(tcpServer_, &QTcpServer::newConnection, this, &ConnectionMan::HandleNewConnection);
   emit LogMessage(QString("Server listening on port %1").arg(port_));
+
+  // без локального сокета клиенты на этой машине работают через TCP
+  auto name = LocalServerName(port_);
+  localServer_ = new QLocalServer();
+  bool listening = localServer_->listen(name);
+  if (!listening && localServer_->serverError() == QAbstractSocket::AddressInUseError) {
+    // файл сокета мог остаться от завершившегося аварийно процесса; он
+    // удаляется, только если по этому имени никто не отвечает
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (!probe.waitForConnected(100)) {
+      QLocalServer::removeServer(name);
+      listening = localServer_->listen(name);
+    }
+  }
+  if (!listening) {
+    emit LogMessage(QString("Failed to listen on local socket: %1").arg(localServer_->errorString()));
+    delete localServer_;
+    localServer_ = nullptr;
+    return;
+  }
+  connect(localServer_, &QLocalServer::newConnection, this, &ConnectionMan::HandleNewLocalConnection);
+  emit LogMessage(QString("Server listening on local socket %1").arg(localServer_->fullServerName()));
 }
 
 void ConnectionMan::StopServer()
@@ -41,11 +68,18 @@ void ConnectionMan::StopServer()
   tcpServer_->close();
   delete tcpServer_;
   tcpServer_ = nullptr;
+  if (localServer_) {
+    localServer_->close();
+    delete localServer_;
+    localServer_ = nullptr;
+  }
   for (auto c : std::as_const(clients_)) {
     c->DisconnectSocket();
     c->deleteLater();
   }
   clients_.clear();
+  relayDevices_.clear();
+  snapshots_.clear();
   emit LogMessage("Server stopped.");
 }
 
@@ -57,34 +91,150 @@ void ConnectionMan::HandleNewConnection()
   while (tcpServer_->hasPendingConnections()) {
     auto sock = tcpServer_->nextPendingConnection();
     auto cid = QString("Client_%1").arg(nextClientId_++);
-    auto conn = new Connection(cid, sock, this);
-    clients_.insert(cid, conn);
-
-    connect(conn, &Connection::Disconnected, this, &ConnectionMan::HandleClientDisconnected);
-    connect(conn, &Connection::JsonObject, this, &ConnectionMan::HandleClientReadyRead);
-    connect(conn, &Connection::ErrorOccurred, this, [this](const QString &id, const QString &err){
-      HandleClientError(id, err);
-    });
-
-    QJsonObject confirm;
-    confirm["type"] = "ConnectAck";
-    confirm["clientId"] = cid;
-    confirm["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
-    conn->SendJson(confirm);
-
-    auto ip = sock->peerAddress().toString();
-    auto port = sock->peerPort();
-
-    emit ClientConnected(cid, ip, port);
-    emit LogMessage(QString("New connection %1 from %2:%3").arg(cid,ip,port));
+    AddConnection(new Connection(cid, sock, this), sock->peerAddress().toString(), sock->peerPort());
+  }
+}
+
+void ConnectionMan::HandleNewLocalConnection()
+{
+  if(!localServer_)
+    return;
+
+  while (localServer_->hasPendingConnections()) {
+    auto sock = localServer_->nextPendingConnection();
+    auto cid = QString("Client_%1").arg(nextClientId_++);
+    AddConnection(new Connection(cid, sock, this), "local", 0);
+  }
+}
+
+void ConnectionMan::AddConnection(Connection *conn, const QString &ip, quint16 port)
+{
+  auto cid = conn->ClientId();
+  clients_.insert(cid, conn);
+  conn->SetMaxFrameSize(maxFrame_);
+
+  connect(conn, &Connection::Disconnected, this, &ConnectionMan::HandleClientDisconnected);
+  connect(conn, &Connection::JsonObject, this, &ConnectionMan::HandleClientReadyRead);
+  connect(conn, &Connection::ErrorOccurred, this, [this](const QString &id, const QString &err){
+    HandleClientError(id, err);
+  });
+  connect(conn, &Connection::BufferPeak, this, &ConnectionMan::ClientBufferPeak);
+
+  QJsonObject confirm;
+  confirm["type"] = "ConnectAck";
+  confirm["clientId"] = cid;
+  confirm["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+
+  // клиенту на той же машине предлагается буфер в разделяемой памяти
+  if(conn->IsLocal()) {
+    auto key = QString("colibri-%1-%2").arg(QCoreApplication::applicationPid()).arg(cid);
+    QString err;
+    if(conn->EnableShm(key, &err))
+      confirm["shm"] = key;
+    else
+      emit LogMessage(QString("Shared memory for %1 unavailable: %2").arg(cid, err));
   }
+  conn->SendJson(confirm);
+
+  emit ClientConnected(cid, ip, port);
+  emit LogMessage(QString("New connection %1 from %2:%3").arg(cid,ip).arg(port));
 }
 
-void ConnectionMan::HandleClientReadyRead(const QJsonObject &obj)
+void ConnectionMan::HandleClientReadyRead(const QJsonObject &obj, const MsgTrace &trace)
 {
   auto conn = qobject_cast<Connection*>(sender());
-  if(conn)
-    emit DataReceived(conn->ClientId(), obj);
+  if(!conn)
+    return;
+
+  auto cid = conn->ClientId();
+  auto in = obj;
+
+  if(obj.value("type").toString() == "RelayHello") {
+    relays_.insert(conn);
+    emit LogMessage(QString("Client %1 is a relay").arg(cid));
+    return;
+  }
+
+  if(obj.contains("device")) {
+    // обычный клиент не может выдавать себя за устройства ретранслятора
+    if(!relays_.contains(conn))
+      return;
+
+    // сообщение от устройства, подключённого через ретранслятор
+    auto device = obj.value("device").toString();
+    auto type = obj.value("type").toString();
+    cid = QString("%1/%2").arg(conn->ClientId(), device);
+
+    if(type == "DeviceConnected") {
+      relayDevices_.insert(cid, {conn, device});
+      auto ip = obj.value("ip").toString();
+      auto port = static_cast<quint16>(obj.value("port").toInt());
+      emit ClientConnected(cid, ip, port);
+      emit LogMessage(QString("New device %1 via relay %2").arg(cid, conn->ClientId()));
+      return;
+    }
+    if(type == "DeviceDisconnected") {
+      RemoveRelayDevice(cid);
+      return;
+    }
+    // кадры необъявленных устройств отбрасываются, состояние для них не заводится
+    if(!relayDevices_.contains(cid))
+      return;
+    in.remove("device");
+  }
+
+  if(passthrough_) {
+    Deliver(cid, in, trace);
+    return;
+  }
+
+  QJsonObject reply;
+  auto full = snapshots_[cid].Apply(in, &reply);
+  if(!reply.isEmpty())
+    SendTo(cid, reply);
+  if(full.isEmpty())
+    return;
+
+  Deliver(cid, full, trace);
+}
+
+void ConnectionMan::Deliver(const QString &clientId, const QJsonObject &obj, const MsgTrace &trace)
+{
+  auto t = trace;
+  t.emitNs = MsgTrace::NowNs();
+  if(lanes_.Push(ClassifyLane(obj), {clientId, obj, t}))
+    emit DataPending();
+}
+
+void ConnectionMan::RemoveRelayDevice(const QString &clientId)
+{
+  if(!relayDevices_.remove(clientId))
+    return;
+  snapshots_.remove(clientId);
+  emit ClientDisconnected(clientId);
+  emit LogMessage(QString("Device %1 disconnected").arg(clientId));
+}
+
+void ConnectionMan::SendTo(const QString &clientId, const QJsonObject &obj)
+{
+  if(auto conn = clients_.value(clientId)) {
+    conn->SendJson(obj);
+    return;
+  }
+
+  auto it = relayDevices_.constFind(clientId);
+  if(it == relayDevices_.cend())
+    return;
+
+  auto tagged = obj;
+  tagged["device"] = it->device;
+  it->relay->SendJson(tagged);
+}
+
+void ConnectionMan::Broadcast(const QJsonObject &obj)
+{
+  for(auto it = clients_.begin(); it != clients_.end(); ++it)
+    it.value()->SendJson(obj);
 }
 
 void ConnectionMan::HandleClientDisconnected()
@@ -93,8 +243,19 @@ void ConnectionMan::HandleClientDisconnected()
   if(conn){
     auto id = conn->ClientId();
     clients_.remove(id);
+    snapshots_.remove(id);
+    relays_.remove(conn);
+
+    QStringList devices;
+    for(auto it = relayDevices_.cbegin(); it != relayDevices_.cend(); ++it)
+      if(it->relay == conn)
+        devices << it.key();
+    for(const auto &d : std::as_const(devices))
+      RemoveRelayDevice(d);
+
     emit ClientDisconnected(id);
-    emit LogMessage(QString("Client %1 disconnected").arg(id));
+    emit LogMessage(QString("Client %1 disconnected (peak buffer %2 bytes)")
+                        .arg(id).arg(conn->PeakBuffered()));
     conn->deleteLater();
   }
 }
@@ -110,9 +271,12 @@ void ConnectionMan::StartClients()
   cmd["type"] = "Command";
   cmd["command"] = "start";
   cmd["cpuWarn"] = cpuWarn_;
+  if(!policy_.isEmpty()) {
+    cmd["policy"] = policy_;
+    cmd["fullInterval"] = fullInterval_;
+  }
 
-  for(auto it = clients_.begin(); it != clients_.end(); ++it)
-    it.value()->SendJson(cmd);
+  Broadcast(cmd);
 }
 
 void ConnectionMan::StopClients()
@@ -120,6 +284,5 @@ void ConnectionMan::StopClients()
   QJsonObject cmd;
   cmd["type"] = "Command";
   cmd["command"] = "stop";
-  for(auto it = clients_.begin(); it != clients_.end(); ++it)
-    it.value()->SendJson(cmd);
+  Broadcast(cmd);
 }
@@ -2,8 +2,14 @@
 
 #include <QObject>
 #include <QHash>
+#include <QSet>
+#include <QJsonObject>
+#include "msgtrace.h"
+#include "snapshotstore.h"
+#include "lanequeue.h"
 
 class QTcpServer;
+class QLocalServer;
 class Connection;
 
 class ConnectionMan : public QObject
@@ -12,14 +18,57 @@ class ConnectionMan : public QObject
 public:
   explicit ConnectionMan(quint16 port = 12345, QObject *parent = nullptr);
   void SetCPUwarn(qint32 v) noexcept {cpuWarn_ = v;}
+  // политика отчётности по метрикам (пустая - клиенты шлют всё как раньше)
+  void SetReportPolicy(const QJsonObject &policy, qint32 fullIntervalMs)
+  {
+    policy_ = policy;
+    fullInterval_ = fullIntervalMs;
+  }
+  // режим ретранслятора: сообщения передаются дальше без восстановления снимков
+  void SetPassthrough(bool v) noexcept {passthrough_ = v;}
+  // ограничение размера кадра для новых подключений
+  void SetMaxFrameSize(qint64 bytes) noexcept {maxFrame_ = bytes;}
   ~ConnectionMan();
 
+  // отправка клиенту, в том числе подключённому через ретранслятор
+  void SendTo(const QString &clientId, const QJsonObject &obj);
+  // отправка всем прямым подключениям (ретрансляторы рассылают устройствам сами)
+  void Broadcast(const QJsonObject &obj);
+
+  // очередь принятых сообщений; потребитель забирает её по сигналу DataPending
+  LaneQueue &Lanes() noexcept {return lanes_;}
+
 private:
   QTcpServer *tcpServer_ = nullptr;
+  // локальный сокет для клиентов на той же машине
+  QLocalServer *localServer_ = nullptr;
   quint16 port_ = 0;
   QHash<QString, Connection*> clients_;
   quint32 nextClientId_ = 0;
   qint32 cpuWarn_ = 0;
+  QJsonObject policy_;
+  qint32 fullInterval_ = 0;
+  // восстановленное состояние метрик по клиентам
+  QHash<QString, SnapshotStore> snapshots_;
+  bool passthrough_ = false;
+  qint64 maxFrame_ = 1024 * 1024;
+
+  // устройство за ретранслятором: ID вида "<ретранслятор>/<устройство>"
+  struct RelayDevice
+  {
+    Connection *relay = nullptr;
+    QString device;
+  };
+  QHash<QString, RelayDevice> relayDevices_;
+  // соединения, представившиеся ретрансляторами (RelayHello); поле "device"
+  // принимается только от них
+  QSet<Connection*> relays_;
+
+  LaneQueue lanes_;
+
+  void RemoveRelayDevice(const QString &clientId);
+  void Deliver(const QString &clientId, const QJsonObject &obj, const MsgTrace &trace);
+  void AddConnection(Connection *conn, const QString &ip, quint16 port);
 
 public slots:
   void StartServer();
@@ -29,13 +78,16 @@ public slots:
 
 private slots:
   void HandleNewConnection();
-  void HandleClientReadyRead(const QJsonObject& obj);
+  void HandleNewLocalConnection();
+  void HandleClientReadyRead(const QJsonObject& obj, const MsgTrace &trace);
   void HandleClientDisconnected();
   void HandleClientError(const QString &clientId, const QString &errmsg);
 
 signals:
   void ClientConnected(const QString &clientId, const QString &ip, quint16 port);
   void ClientDisconnected(const QString &clientId);
-  void DataReceived(const QString &clientId, const QJsonObject &obj);
+  void ClientBufferPeak(const QString &clientId, qint64 bytes);
+  // очередь Lanes() перешла из пустого состояния в непустое
+  void DataPending();
   void LogMessage(const QString &msg);
 };
@@ -12,9 +12,34 @@
 #include <QSpinBox>
 #include <QLabel>
 #include <QThread>
+#include <QTimer>
+#include <QFileDialog>
+#include <QCheckBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLocale>
 
 static const auto DTFormt = QLatin1String("yyyy-MM-dd hh:mm:ss");
 
+// политика отчётности по умолчанию: метрика, дедбэнд, мин. и макс. интервалы (мс)
+struct MetricPolicy
+{
+  const char *metric;
+  double deadband;
+  int minInterval;
+  int maxInterval;
+};
+
+static const MetricPolicy DefaultPolicy[] = {
+  {"bandwidth", 50.0, 0, 10000},
+  {"latency", 20.0, 0, 10000},
+  {"packet_loss", 0.01, 0, 10000},
+  {"interfaces", 0.0, 1000, 10000},
+  {"uptime", 60000.0, 0, 60000},
+  {"cpu_usage", 5.0, 0, 10000},
+  {"memory_usage", 5.0, 0, 10000},
+};
+
 CentralWidget::CentralWidget(QWidget *parent) : QWidget(parent)
 {
   setMinimumSize(640,480);
@@ -39,14 +64,62 @@ CentralWidget::CentralWidget(QWidget *parent) : QWidget(parent)
   layControl_->addWidget(cpuWarn_);
   layControl_->addWidget(new QLabel(QString("%"),this));
 
-  clients_ = new QTableWidget(0,3,this);
-  clients_->setHorizontalHeaderLabels(QStringList() << "ID" << "Address" << "Status");
+  clients_ = new QTableWidget(0,4,this);
+  clients_->setHorizontalHeaderLabels(QStringList() << "ID" << "Address" << "Status" << "Peak buffer");
   clients_->setSelectionBehavior(QAbstractItemView::SelectRows);
 
   messages_ = new QTableWidget(0,5,this);
+  messages_->setObjectName("messages");
   messages_->setHorizontalHeaderLabels(QStringList() << "ID" << "Type" << "Content" << "JSON" << "Received");
   messages_->setSelectionBehavior(QAbstractItemView::SelectRows);
   log_ = new QTextBrowser(this);
+  log_->setObjectName("log");
+
+  auto latencyPage = new QWidget(this);
+  auto latencyLay = new QVBoxLayout(latencyPage);
+  exportTraces_ = new QPushButton("Export traces", latencyPage);
+  latency_ = new QTableWidget(0,6,latencyPage);
+  latency_->setHorizontalHeaderLabels(QStringList() << "ID" << "Stage" << "Count"
+                                                    << "p50, us" << "p99, us" << "Max, us");
+  lanes_ = new QLabel(latencyPage);
+  auto latencyTop = new QHBoxLayout();
+  latencyTop->addWidget(lanes_, 1);
+  latencyTop->addWidget(exportTraces_);
+  latencyLay->addLayout(latencyTop);
+  latencyLay->addWidget(latency_);
+
+  auto policyPage = new QWidget(this);
+  auto policyLay = new QFormLayout(policyPage);
+  deltaReporting_ = new QCheckBox("Deadband and delta reporting", policyPage);
+  deltaReporting_->setChecked(false); // по умолчанию - прежнее поведение, все значения каждый раз
+  fullInterval_ = new QSpinBox(policyPage);
+  fullInterval_->setRange(1000, 3600000);
+  fullInterval_->setSingleStep(1000);
+  fullInterval_->setValue(60000);
+  maxFrame_ = new QSpinBox(policyPage);
+  maxFrame_->setRange(1, 64 * 1024);
+  maxFrame_->setValue(1024);
+  policy_ = new QTableWidget(0,4,policyPage);
+  policy_->setHorizontalHeaderLabels(QStringList() << "Metric" << "Deadband"
+                                                   << "Min interval, ms" << "Max interval, ms");
+  policy_->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+  for (const auto &p : DefaultPolicy) {
+    int row = policy_->rowCount();
+    policy_->insertRow(row);
+    auto name = new QTableWidgetItem(p.metric);
+    name->setFlags(name->flags() & ~Qt::ItemIsEditable);
+    policy_->setItem(row, 0, name);
+    policy_->setItem(row, 1, new QTableWidgetItem(QString::number(p.deadband)));
+    policy_->setItem(row, 2, new QTableWidgetItem(QString::number(p.minInterval)));
+    policy_->setItem(row, 3, new QTableWidgetItem(QString::number(p.maxInterval)));
+  }
+  policyLay->addRow(deltaReporting_);
+  policyLay->addRow("Full snapshot interval, ms", fullInterval_);
+  policyLay->addRow(policy_);
+  policyLay->addRow("Max frame size (applies on server start), KiB", maxFrame_);
+
+  latencyTimer_ = new QTimer(this);
+  latencyTimer_->setInterval(1000);
 
   lay_ = new QVBoxLayout(this);
   tab_ = new QTabWidget(this);
@@ -54,6 +127,8 @@ CentralWidget::CentralWidget(QWidget *parent) : QWidget(parent)
   tab_->addTab(clients_,"Clients");
   tab_->addTab(messages_,"Messages");
   tab_->addTab(log_,"Log");
+  tab_->addTab(latencyPage,"Latency");
+  tab_->addTab(policyPage,"Reporting");
 
   lay_->addLayout(layControl_);
   lay_->addWidget(tab_);
@@ -63,10 +138,15 @@ CentralWidget::CentralWidget(QWidget *parent) : QWidget(parent)
   connect(sStop_, &QPushButton::clicked, this, &CentralWidget::OnStopServer);
   connect(cStart_, &QPushButton::clicked, this, &CentralWidget::OnStartClientsClicked);
   connect(cStop_, &QPushButton::clicked, this, &CentralWidget::OnStopClientsClicked);
+  connect(exportTraces_, &QPushButton::clicked, this, &CentralWidget::OnExportTracesClicked);
+  connect(latencyTimer_, &QTimer::timeout, this, &CentralWidget::OnRefreshLatency);
+  latencyTimer_->start();
 }
 
 void CentralWidget::InitializeServer()
 {
+  qRegisterMetaType<MsgTrace>();
+
   worker_ = new ConnectionMan(12345);
   workerThread_ = new QThread(this);
   worker_->moveToThread(workerThread_);
@@ -76,7 +156,8 @@ void CentralWidget::InitializeServer()
 
   connect(worker_, &ConnectionMan::ClientConnected, this, &CentralWidget::OnClientConnected);
   connect(worker_, &ConnectionMan::ClientDisconnected, this, &CentralWidget::OnClientDisconnected);
-  connect(worker_, &ConnectionMan::DataReceived, this, &CentralWidget::OnDataReceived);
+  connect(worker_, &ConnectionMan::ClientBufferPeak, this, &CentralWidget::OnClientBufferPeak);
+  connect(worker_, &ConnectionMan::DataPending, this, &CentralWidget::OnDataPending);
   connect(worker_, &ConnectionMan::LogMessage, this, &CentralWidget::OnLogMessage);
 
   workerThread_->start();
@@ -87,15 +168,21 @@ CentralWidget::~CentralWidget()
   if(worker_)
     QMetaObject::invokeMethod(worker_, "StopServer", Qt::QueuedConnection);
 
-  workerThread_->quit();
-  workerThread_->wait();
+  if(workerThread_) {
+    workerThread_->quit();
+    workerThread_->wait();
+  }
 }
 
 void CentralWidget::OnStartServer()
 {
   if(!worker_)
     return;
-  QMetaObject::invokeMethod(worker_, "StartServer", Qt::QueuedConnection);
+  QMetaObject::invokeMethod(worker_,
+                            [this, maxFrame = qint64(maxFrame_->value()) * 1024]() {
+                              worker_->SetMaxFrameSize(maxFrame);
+                              worker_->StartServer();
+                            },Qt::QueuedConnection);
   sStart_->setEnabled(false);
   sStop_->setEnabled(true);
   cStart_->setEnabled(true);
@@ -123,10 +210,66 @@ void CentralWidget::OnClientConnected(const QString &clientId, const QString &ip
 void CentralWidget::OnClientDisconnected(const QString &clientId)
 {
   AddClientRow(clientId, "-", "Disconnected");
+  // устройства ретранслятора переподключаются под новыми ID, без удаления
+  // гистограммы копились бы неограниченно
+  latencyStats_.Remove(clientId);
+
+  // последняя часть уже не придёт: выводится то, что успело накопиться
+  for (auto it = logStreams_.begin(); it != logStreams_.end();) {
+    if (it->clientId != clientId) {
+      ++it;
+      continue;
+    }
+    if (!it->truncated) {
+      it->broken = true;
+      FinishLogStream(it.value(), QString("(interrupted after %1 parts)").arg(it->received));
+    }
+    it = logStreams_.erase(it);
+  }
   OnLogMessage(QString("Client disconnected: %1").arg(clientId));
 }
 
-void CentralWidget::OnDataReceived(const QString &clientId, const QJsonObject &obj)
+void CentralWidget::OnDataPending()
+{
+  static constexpr qsizetype kBulkBudget = 200; // строк Bulk за один проход цикла событий
+
+  if(!worker_)
+    return;
+
+  // все сообщения High и ограниченная порция Bulk, чтобы новые High
+  // не ждали разбора всей накопившейся телеметрии
+  bool more = false;
+  const auto items = worker_->Lanes().Take(kBulkBudget, &more);
+  for (const auto &i : items)
+    OnDataReceived(i.clientId, i.obj, i.trace);
+
+  if(more)
+    QMetaObject::invokeMethod(this, &CentralWidget::OnDataPending, Qt::QueuedConnection);
+}
+
+void CentralWidget::OnDataReceived(const QString &clientId, const QJsonObject &obj, const MsgTrace &trace)
+{
+  auto t = trace;
+  t.dequeueNs = MsgTrace::NowNs();
+
+  auto type = obj.value("type").toString("Unknown");
+
+  if (type == "LogChunk") {
+    AppendLogChunk(clientId, obj);
+    t.renderNs = MsgTrace::NowNs();
+    latencyStats_.Add(clientId, t);
+    return;
+  }
+
+  InsertMessageRow(clientId, obj);
+
+  t.renderNs = MsgTrace::NowNs();
+  latencyStats_.Add(clientId, t);
+
+  OnLogMessage(QString("Data from %1: %2").arg(clientId,type));
+}
+
+void CentralWidget::InsertMessageRow(const QString &clientId, const QJsonObject &obj)
 {
   auto type = obj.value("type").toString("Unknown");
   auto raw = QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact));
@@ -137,7 +280,7 @@ void CentralWidget::OnDataReceived(const QString &clientId, const QJsonObject &o
   if (type == "NetworkMetrics" || type == "DeviceStatus") {
     QStringList parts;
     for (auto it = obj.begin(); it != obj.end(); ++it) {
-      if (it.key() == "type")
+      if (it.key() == "type" || it.key() == "seq" || it.key() == "sentAt")
         continue;
       auto v = it.value();
       parts << QString("%1=%2").arg(it.key(),v.toVariant().toString());
@@ -163,8 +306,112 @@ void CentralWidget::OnDataReceived(const QString &clientId, const QJsonObject &o
   if(warn)
     for(int i = 0; i < 5; i++)
       messages_->item(row,i)->setBackground(QColor(255,255,0,40));
+}
 
-  OnLogMessage(QString("Data from %1: %2").arg(clientId,type));
+void CentralWidget::AppendLogChunk(const QString &clientId, const QJsonObject &obj)
+{
+  // память на незавершённые логи ограничена: не больше kMaxOpenStreams
+  // потоков на клиента и kMaxStreamChars символов на поток
+  static constexpr int kMaxOpenStreams = 4;
+  static constexpr qsizetype kMaxStreamChars = 1024 * 1024;
+
+  auto key = QString("%1/%2").arg(clientId).arg(obj.value("stream").toInteger());
+  auto part = obj.value("part").toInteger();
+  auto it = logStreams_.find(key);
+
+  if (it == logStreams_.end()) {
+    // самый старый открытый поток клиента закрывается как обрезанный
+    int open = 0;
+    auto oldest = logStreams_.end();
+    for (auto s = logStreams_.begin(); s != logStreams_.end(); ++s) {
+      if (s->clientId != clientId)
+        continue;
+      ++open;
+      if (oldest == logStreams_.end() || s->row < oldest->row)
+        oldest = s;
+    }
+    if (open >= kMaxOpenStreams) {
+      if (!oldest->truncated)
+        FinishLogStream(*oldest, QString("(truncated: too many open streams, %1 parts)").arg(oldest->received));
+      logStreams_.erase(oldest);
+    }
+
+    LogStream ls;
+    ls.clientId = clientId;
+    ls.prefix = "[" + obj.value("severity").toString() + "] ";
+    ls.row = messages_->rowCount();
+    messages_->insertRow(ls.row);
+    messages_->setItem(ls.row, 0, new QTableWidgetItem(clientId));
+    messages_->setItem(ls.row, 1, new QTableWidgetItem("Log"));
+    messages_->setItem(ls.row, 2, new QTableWidgetItem(ls.prefix));
+    messages_->setItem(ls.row, 3, new QTableWidgetItem("(receiving chunks)"));
+    messages_->setItem(ls.row, 4, new QTableWidgetItem(QDateTime::currentDateTime().toString(DTFormt)));
+    if(!QString::compare(obj.value("severity").toString(),"warn",Qt::CaseInsensitive))
+      for(int i = 0; i < 5; i++)
+        messages_->item(ls.row,i)->setBackground(QColor(255,255,0,40));
+    it = logStreams_.insert(key, ls);
+  }
+
+  auto &ls = it.value();
+  ls.received++;
+  if (ls.truncated) {
+    // строка уже выведена, остальные части только отсчитываются
+    if (obj.value("last").toBool())
+      logStreams_.erase(it);
+    return;
+  }
+
+  if (part != ls.nextPart) {
+    // пропуск или перестановка отмечаются прямо в тексте
+    ls.broken = true;
+    if (part > ls.nextPart)
+      ls.text += QString(" [parts %1..%2 missing] ").arg(ls.nextPart).arg(part - 1);
+    else
+      ls.text += QString(" [part %1 out of order] ").arg(part);
+  }
+  ls.nextPart = qMax(ls.nextPart, part + 1);
+
+  auto message = obj.value("message").toString();
+  if (ls.text.size() + message.size() > kMaxStreamChars) {
+    ls.text += message.left(qMax<qsizetype>(0, kMaxStreamChars - ls.text.size()));
+    ls.text += " [truncated]";
+    FinishLogStream(ls, QString("(truncated after %1 parts)").arg(ls.received));
+    OnLogMessage(QString("Data from %1: Log truncated at %2 characters").arg(clientId).arg(kMaxStreamChars));
+    ls.truncated = true;
+    ls.text = QString();
+    if (obj.value("last").toBool())
+      logStreams_.erase(it);
+    return;
+  }
+  ls.text += message;
+
+  if (!obj.value("last").toBool()) {
+    messages_->item(ls.row, 3)->setText(QString("(receiving chunks: %1)").arg(ls.received));
+    return;
+  }
+
+  auto status = ls.broken ? QString("(chunked, %1 parts, incomplete)").arg(ls.received)
+                          : QString("(chunked, %1 parts)").arg(ls.received);
+  FinishLogStream(ls, status);
+  OnLogMessage(QString("Data from %1: Log (%2 chunks)").arg(clientId).arg(ls.received));
+  logStreams_.erase(it);
+}
+
+void CentralWidget::FinishLogStream(const LogStream &ls, const QString &status)
+{
+  messages_->item(ls.row, 2)->setText(ls.prefix + ls.text);
+  messages_->item(ls.row, 3)->setText(status);
+  if (ls.broken)
+    for(int i = 0; i < 5; i++)
+      messages_->item(ls.row,i)->setBackground(QColor(255,0,0,40));
+}
+
+void CentralWidget::OnClientBufferPeak(const QString &clientId, qint64 bytes)
+{
+  if (!clientRows_.contains(clientId))
+    return;
+  clients_->setItem(clientRows_.value(clientId), 3,
+                    new QTableWidgetItem(QLocale().formattedDataSize(bytes)));
 }
 
 void CentralWidget::OnLogMessage(const QString &msg)
@@ -210,13 +457,30 @@ void CentralWidget::OnStartClientsClicked()
   cStart_->setEnabled(false);
   cStop_->setEnabled(true);
   QMetaObject::invokeMethod(worker_,
-                            [this]() {
+                            [this, policy = ReportPolicy(), full = fullInterval_->value()]() {
                               worker_->SetCPUwarn(cpuWarn_->value());
+                              worker_->SetReportPolicy(policy, full);
                               worker_->StartClients();
                             },Qt::QueuedConnection);
   OnLogMessage("Starting clients ...");
 }
 
+QJsonObject CentralWidget::ReportPolicy() const
+{
+  QJsonObject result;
+  if(!deltaReporting_->isChecked())
+    return result;
+
+  for (int r = 0; r < policy_->rowCount(); ++r) {
+    QJsonObject p;
+    p["deadband"] = policy_->item(r,1)->text().toDouble();
+    p["minInterval"] = policy_->item(r,2)->text().toInt();
+    p["maxInterval"] = policy_->item(r,3)->text().toInt();
+    result[policy_->item(r,0)->text()] = p;
+  }
+  return result;
+}
+
 void CentralWidget::OnStopClientsClicked()
 {
   if(!worker_)
@@ -226,3 +490,49 @@ void CentralWidget::OnStopClientsClicked()
   QMetaObject::invokeMethod(worker_, "StopClients", Qt::QueuedConnection);
   OnLogMessage("Stopping clients ...");
 }
+
+void CentralWidget::OnRefreshLatency()
+{
+  if(!latency_->isVisible())
+    return;
+
+  if(worker_) {
+    QStringList lanes;
+    for (auto lane : {Lane::High, Lane::Bulk}) {
+      auto st = worker_->Lanes().Stats(lane);
+      lanes << QString("%1: depth %2 (max %3), wait p99 %4 us")
+                   .arg(LaneName(lane)).arg(st.depth).arg(st.maxDepth)
+                   .arg(st.wait.Percentile(0.99));
+    }
+    lanes_->setText(lanes.join("; "));
+  }
+
+  const auto &all = latencyStats_.PerClient();
+  latency_->setRowCount(all.size() * LatencyStats::StageCount);
+
+  int row = 0;
+  for (auto it = all.begin(); it != all.end(); ++it) {
+    for (int s = 0; s < LatencyStats::StageCount; ++s, ++row) {
+      const auto &h = it.value()[s];
+      latency_->setItem(row, 0, new QTableWidgetItem(it.key()));
+      latency_->setItem(row, 1, new QTableWidgetItem(LatencyStats::StageName(s)));
+      latency_->setItem(row, 2, new QTableWidgetItem(QString::number(h.count)));
+      latency_->setItem(row, 3, new QTableWidgetItem(QString::number(h.Percentile(0.5))));
+      latency_->setItem(row, 4, new QTableWidgetItem(QString::number(h.Percentile(0.99))));
+      latency_->setItem(row, 5, new QTableWidgetItem(QString::number(h.max)));
+    }
+  }
+}
+
+void CentralWidget::OnExportTracesClicked()
+{
+  auto path = QFileDialog::getSaveFileName(this, "Export traces", "traces.csv", "CSV (*.csv)");
+  if(path.isEmpty())
+    return;
+
+  QString err;
+  if(latencyStats_.ExportSamples(path, &err))
+    OnLogMessage(QString("Traces exported to %1").arg(path));
+  else
+    OnLogMessage(QString("Failed to export traces: %1").arg(err));
+}
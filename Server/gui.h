@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QMainWindow>
+#include "latencystats.h"
 
 class QHBoxLayout;
 class QPushButton;
@@ -11,6 +12,9 @@ class QTextBrowser;
 class ConnectionMan;
 class QSpinBox;
 class QThread;
+class QTimer;
+class QCheckBox;
+class QLabel;
 
 class CentralWidget : public QWidget
 {
@@ -37,25 +41,65 @@ private:
   QTableWidget *messages_ = nullptr;
   QTextBrowser *log_ = nullptr;
 
+         // задержки по стадиям прохождения сообщений
+  QTableWidget *latency_ = nullptr;
+  QPushButton *exportTraces_ = nullptr;
+  QLabel *lanes_ = nullptr;
+  QTimer *latencyTimer_ = nullptr;
+  LatencyStats latencyStats_;
+
+         // политика отчётности клиентов (дедбэнд, интервалы, дельты)
+  QCheckBox *deltaReporting_ = nullptr;
+  QSpinBox *fullInterval_ = nullptr;
+  QSpinBox *maxFrame_ = nullptr;
+  QTableWidget *policy_ = nullptr;
+
          // бизнес-логика в отдельном потоке
   ConnectionMan *worker_ = nullptr;
   QThread *workerThread_ = nullptr;
 
   QMap<QString,int> clientRows_;
+  // незавершённый длинный лог: текст копится здесь (с ограничением размера)
+  // и выводится в строку таблицы целиком по приходу последней части
+  struct LogStream
+  {
+    QString clientId;
+    int row = -1;
+    QString prefix;        // "[severity] "
+    QString text;
+    qint64 nextPart = 0;   // номер ожидаемой части
+    qint64 received = 0;
+    bool broken = false;   // были пропуски или части не по порядку
+    bool truncated = false;// превышен предел, строка выведена, текст не копится
+  };
+  // ключ: "<клиент>/<поток>"
+  QHash<QString,LogStream> logStreams_;
 
   void AddClientRow(const QString &clientId, const QString &ip, const QString &status);
   void RemoveClientRow(const QString &clientId);
+  QJsonObject ReportPolicy() const;
+  // дописывание части длинного лога в его строку таблицы
+  void AppendLogChunk(const QString &clientId, const QJsonObject &obj);
+  // вывод накопленного текста и состояния потока в его строку
+  void FinishLogStream(const LogStream &ls, const QString &status);
 
 private slots:
   void OnStartServer();
   void OnStopServer();
   void OnClientConnected(const QString &clientId, const QString &ip, quint16 port);
   void OnClientDisconnected(const QString &clientId);
-  void OnDataReceived(const QString &clientId, const QJsonObject &obj);
+  void OnClientBufferPeak(const QString &clientId, qint64 bytes);
+  void OnDataPending();
+  void OnDataReceived(const QString &clientId, const QJsonObject &obj, const MsgTrace &trace);
+  // разбор сообщения и вставка его строки в таблицу, без записи в журнал
+  void InsertMessageRow(const QString &clientId, const QJsonObject &obj);
   void OnLogMessage(const QString &msg);
 
   void OnStartClientsClicked();
   void OnStopClientsClicked();
+
+  void OnRefreshLatency();
+  void OnExportTracesClicked();
 };
 
 ////////////////////////////////////////////
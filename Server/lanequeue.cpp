@@ -0,0 +1,46 @@
+#include "lanequeue.h"
+
+bool LaneQueue::Push(Lane lane, const Item &item)
+{
+  QMutexLocker lock(&mutex_);
+
+  bool wasEmpty = true;
+  for(const auto &q : queues_)
+    wasEmpty = wasEmpty && q.isEmpty();
+
+  auto l = static_cast<int>(lane);
+  queues_[l].enqueue(item);
+  stats_[l].maxDepth = qMax(stats_[l].maxDepth, queues_[l].size());
+  return wasEmpty;
+}
+
+QList<LaneQueue::Item> LaneQueue::Take(qsizetype bulkBudget, bool *more)
+{
+  QMutexLocker lock(&mutex_);
+
+  QList<Item> result;
+  auto now = MsgTrace::NowNs();
+  auto takeFrom = [&](int l, qsizetype limit) {
+    auto &q = queues_[l];
+    for(qsizetype i = 0; i < limit && !q.isEmpty(); ++i) {
+      result.append(q.dequeue());
+      stats_[l].wait.Add((now - result.constLast().trace.emitNs) / 1000);
+    }
+  };
+
+  takeFrom(static_cast<int>(Lane::High), queues_[static_cast<int>(Lane::High)].size());
+  takeFrom(static_cast<int>(Lane::Bulk), bulkBudget);
+
+  *more = !queues_[static_cast<int>(Lane::Bulk)].isEmpty();
+  return result;
+}
+
+LaneQueue::LaneStats LaneQueue::Stats(Lane lane) const
+{
+  QMutexLocker lock(&mutex_);
+
+  auto l = static_cast<int>(lane);
+  auto st = stats_[l];
+  st.depth = queues_[l].size();
+  return st;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include "lanes.h"
+#include "latencystats.h"
+#include "msgtrace.h"
+
+// Потокобезопасная очередь сообщений из потока бизнес-логики в поток GUI
+// с разделением по полосам приоритета.
+class LaneQueue
+{
+public:
+  struct Item
+  {
+    QString clientId;
+    QJsonObject obj;
+    MsgTrace trace;
+  };
+
+  struct LaneStats
+  {
+    qsizetype depth = 0;
+    qsizetype maxDepth = 0;
+    LatencyStats::Histogram wait; // ожидание в очереди, мкс
+  };
+
+  // возвращает true, если очередь была пуста и потребителя нужно разбудить
+  bool Push(Lane lane, const Item &item);
+  // забирает все элементы High и не более bulkBudget элементов Bulk;
+  // more - остались ли элементы после выборки
+  QList<Item> Take(qsizetype bulkBudget, bool *more);
+
+  LaneStats Stats(Lane lane) const;
+
+private:
+  mutable QMutex mutex_;
+  QQueue<Item> queues_[kLaneCount];
+  LaneStats stats_[kLaneCount];
+};
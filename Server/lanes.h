@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QString>
+
+// Полосы приоритета: команды, подтверждения и предупреждения не должны
+// ждать за потоком телеметрии.
+enum class Lane { High, Bulk };
+constexpr int kLaneCount = 2;
+
+inline const char *LaneName(Lane lane) noexcept
+{
+  return lane == Lane::High ? "high" : "bulk";
+}
+
+inline Lane ClassifyLane(const QJsonObject &obj)
+{
+  auto type = obj.value("type").toString();
+
+  if(type == "Command" || type == "ConnectAck" || type == "SnapshotAck"
+      || type == "RelayHello" || type == "DeviceConnected" || type == "DeviceDisconnected")
+    return Lane::High;
+
+  // части длинного лога идут в полосе своей важности, как и целый Log;
+  // у всех частей одного потока важность одна, поэтому порядок сохраняется
+  if(type == "Log" || type == "LogChunk") {
+    auto s = obj.value("severity").toString();
+    if(!s.compare("warn", Qt::CaseInsensitive) || !s.compare("error", Qt::CaseInsensitive))
+      return Lane::High;
+  }
+  return Lane::Bulk;
+}
+
+// части длинного лога не отбрасываются при переполнении очереди Bulk:
+// сервер собирает сообщение по номерам частей, и пропуск портит его целиком
+inline bool IsDroppable(const QJsonObject &obj)
+{
+  return obj.value("type").toString() != "LogChunk";
+}
@@ -0,0 +1,77 @@
+#include "lanewriter.h"
+
+#include <algorithm>
+
+LaneWriter::LaneWriter(QIODevice *dev, QObject *parent) : QObject(parent)
+{
+  clock_.start();
+  SetDevice(dev);
+}
+
+void LaneWriter::SetDevice(QIODevice *dev)
+{
+  if(dev_ == dev)
+    return;
+  if(dev_)
+    disconnect(dev_, &QIODevice::bytesWritten, this, &LaneWriter::Flush);
+
+  Clear();
+  dev_ = dev;
+  connect(dev_, &QIODevice::bytesWritten, this, &LaneWriter::Flush);
+}
+
+void LaneWriter::Write(Lane lane, const QByteArray &frame, bool droppable)
+{
+  // High пишется сразу: впереди в буфере может быть не больше одного кадра Bulk
+  if(lane == Lane::High || (bulk_.isEmpty() && !dev_->bytesToWrite())) {
+    dev_->write(frame);
+    return;
+  }
+
+  if(bulk_.size() >= kMaxBulk) {
+    auto it = std::find_if(bulk_.begin(), bulk_.end(), [](const Pending &p) { return p.droppable; });
+    if(it != bulk_.end()) {
+      bulk_.erase(it);
+      bulkStats_.dropped++;
+    } else if(bulk_.size() >= 2 * kMaxBulk) {
+      // источник не соблюдает BulkFull: очередь всё равно ограничена,
+      // а пропуск части сервер отметит в сообщении
+      bulkStats_.dropped++;
+      return;
+    }
+  }
+  bulk_.enqueue({frame, clock_.elapsed(), droppable});
+  bulkStats_.maxDepth = qMax(bulkStats_.maxDepth, bulk_.size());
+}
+
+void LaneWriter::Flush()
+{
+  if(bulk_.isEmpty() || dev_->bytesToWrite())
+    return;
+
+  bool full = BulkFull();
+  auto p = bulk_.dequeue();
+  bulkStats_.maxWaitMs = qMax(bulkStats_.maxWaitMs, clock_.elapsed() - p.queuedMs);
+  dev_->write(p.frame);
+  if(full && !BulkFull())
+    emit BulkSpace();
+}
+
+void LaneWriter::Clear()
+{
+  bulk_.clear();
+}
+
+LaneWriter::LaneStats LaneWriter::Stats(Lane lane) const
+{
+  if(lane == Lane::High)
+    return {};
+  auto st = bulkStats_;
+  st.depth = bulk_.size();
+  return st;
+}
+
+void LaneWriter::ResetStats()
+{
+  bulkStats_ = LaneStats();
+}
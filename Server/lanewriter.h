@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QQueue>
+#include "lanes.h"
+
+// Запись кадров в устройство с учётом приоритета: кадры High уходят сразу,
+// кадры Bulk - по одному, только когда буфер устройства пуст. Поэтому кадр
+// High ждёт в буфере устройства не больше одного кадра Bulk (не считая
+// буфера отправки ядра).
+class LaneWriter : public QObject
+{
+  Q_OBJECT
+public:
+  struct LaneStats
+  {
+    qsizetype depth = 0;    // кадров в очереди сейчас
+    qsizetype maxDepth = 0; // максимум с последнего сброса
+    qint64 maxWaitMs = 0;   // максимальное ожидание в очереди
+    quint64 dropped = 0;    // отброшено при переполнении
+  };
+
+  explicit LaneWriter(QIODevice *dev, QObject *parent = nullptr);
+
+  // переключение на другое устройство; очереди сбрасываются
+  void SetDevice(QIODevice *dev);
+  // при переполнении Bulk отбрасывается самый старый кадр с droppable;
+  // кадры без droppable отбрасываются только сверх 2 * kMaxBulk, поэтому
+  // их источник должен сам ждать места в очереди (BulkFull/BulkSpace)
+  void Write(Lane lane, const QByteArray &frame, bool droppable = true);
+  bool BulkFull() const noexcept { return bulk_.size() >= kMaxBulk; }
+  // сброс очередей (например, при потере соединения)
+  void Clear();
+
+  // очередь есть только у Bulk, для High статистика всегда нулевая
+  LaneStats Stats(Lane lane) const;
+  void ResetStats();
+
+signals:
+  // в заполненной очереди Bulk освободилось место
+  void BulkSpace();
+
+private slots:
+  void Flush();
+
+private:
+  static constexpr qsizetype kMaxBulk = 10000;
+
+  struct Pending
+  {
+    QByteArray frame;
+    qint64 queuedMs = 0;
+    bool droppable = true;
+  };
+
+  QIODevice *dev_ = nullptr;
+  QQueue<Pending> bulk_;
+  LaneStats bulkStats_;
+  QElapsedTimer clock_;
+};
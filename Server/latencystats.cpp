@@ -0,0 +1,136 @@
+#include "latencystats.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+namespace
+{
+
+// ID устройств ретранслятора содержат '/', а в общем случае ID может
+// содержать запятые и кавычки - поле всегда берётся в кавычки (RFC 4180)
+QString CsvField(const QString &s)
+{
+  auto escaped = s;
+  escaped.replace('"', "\"\"");
+  return '"' + escaped + '"';
+}
+
+}  // namespace
+
+void LatencyStats::Histogram::Add(qint64 us) noexcept
+{
+  if(us < 0)
+    us = 0;  // расхождение часов клиента и сервера
+
+  int idx = 64 - qCountLeadingZeroBits(static_cast<quint64>(us));
+  buckets[qMin(idx, kBuckets - 1)]++;
+  count++;
+  max = qMax(max, us);
+}
+
+int LatencyStats::Histogram::Bucket(double p) const noexcept
+{
+  auto rank = static_cast<quint64>(p * count);
+  quint64 acc = 0;
+  for(int i = 0; i < kBuckets; ++i) {
+    acc += buckets[i];
+    if(acc > rank)
+      return i;
+  }
+  return kBuckets - 1;
+}
+
+qint64 LatencyStats::Histogram::Percentile(double p) const noexcept
+{
+  if(!count)
+    return 0;
+  return qMin<qint64>((qint64(1) << Bucket(p)) - 1, max);
+}
+
+qint64 LatencyStats::Histogram::PercentileFloor(double p) const noexcept
+{
+  if(!count)
+    return 0;
+  auto i = Bucket(p);
+  return i ? qint64(1) << (i - 1) : 0;
+}
+
+const char *LatencyStats::StageName(int stage) noexcept
+{
+  switch (stage) {
+    case Network: return "network";
+    case Batch: return "batch";
+    case Parse: return "parse";
+    case Emit: return "emit";
+    case Dequeue: return "dequeue";
+    case Render: return "render";
+    case Total: return "total";
+    default: return "?";
+  }
+}
+
+qint64 LatencyStats::StageUs(const MsgTrace &t, int stage) noexcept
+{
+  switch (stage) {
+    case Network: return t.sentMs ? (t.readMs - t.sentMs) * 1000 : 0;
+    case Batch: return (t.parseStartNs - t.readNs) / 1000;
+    case Parse: return (t.parseNs - t.parseStartNs) / 1000;
+    case Emit: return (t.emitNs - t.parseNs) / 1000;
+    case Dequeue: return (t.dequeueNs - t.emitNs) / 1000;
+    case Render: return (t.renderNs - t.dequeueNs) / 1000;
+    case Total: return StageUs(t, Network) + (t.renderNs - t.readNs) / 1000;
+    default: return 0;
+  }
+}
+
+void LatencyStats::Add(const QString &clientId, const MsgTrace &t)
+{
+  auto &h = clients_[clientId];
+  auto total = StageUs(t, Total);
+  bool tail = h[Total].count && total >= h[Total].PercentileFloor(0.99);
+
+  for(int s = 0; s < StageCount; ++s)
+    h[s].Add(StageUs(t, s));
+
+  if(++counter_ % sampleEvery_ && !tail)
+    return;
+
+  if(samples_.size() < kMaxSamples) {
+    samples_.append({clientId, t});
+  } else {
+    samples_[nextSample_] = {clientId, t};
+    nextSample_ = (nextSample_ + 1) % kMaxSamples;
+  }
+}
+
+void LatencyStats::Remove(const QString &clientId)
+{
+  clients_.remove(clientId);
+}
+
+bool LatencyStats::ExportSamples(const QString &path, QString *error) const
+{
+  QFile f(path);
+  if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+    if(error)
+      *error = f.errorString();
+    return false;
+  }
+
+  QTextStream out(&f);
+  out << "client,seq,sent_ms";
+  for(int s = 0; s < StageCount; ++s)
+    out << ',' << StageName(s) << "_us";
+  out << '\n';
+
+  // от самой старой трассы к самой новой
+  for(int i = 0; i < samples_.size(); ++i) {
+    const auto &smp = samples_[(nextSample_ + i) % samples_.size()];
+    out << CsvField(smp.clientId) << ',' << smp.trace.seq << ',' << smp.trace.sentMs;
+    for(int s = 0; s < StageCount; ++s)
+      out << ',' << StageUs(smp.trace, s);
+    out << '\n';
+  }
+  return true;
+}
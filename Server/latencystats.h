@@ -0,0 +1,67 @@
+#pragma once
+
+#include "msgtrace.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <array>
+
+// Агрегирование задержек по стадиям в гистограммы для каждого клиента
+// и хранение выборки трасс для последующего анализа хвостов.
+class LatencyStats
+{
+public:
+  enum Stage { Network, Batch, Parse, Emit, Dequeue, Render, Total, StageCount };
+
+  // логарифмическая гистограмма: корзина i содержит значения < 2^i мкс
+  struct Histogram
+  {
+    static constexpr int kBuckets = 32;
+    std::array<quint64, kBuckets> buckets{};
+    quint64 count = 0;
+    qint64 max = 0;
+
+    void Add(qint64 us) noexcept;
+    // верхняя граница корзины, в которую попадает перцентиль p (0..1)
+    qint64 Percentile(double p) const noexcept;
+    // нижняя граница той же корзины
+    qint64 PercentileFloor(double p) const noexcept;
+
+  private:
+    int Bucket(double p) const noexcept;
+  };
+
+  struct Sample
+  {
+    QString clientId;
+    MsgTrace trace;
+  };
+
+  using ClientHistograms = std::array<Histogram, StageCount>;
+
+  static const char *StageName(int stage) noexcept;
+  // длительность стадии в мкс
+  static qint64 StageUs(const MsgTrace &t, int stage) noexcept;
+
+  void Add(const QString &clientId, const MsgTrace &t);
+  // гистограммы отключившегося клиента; выборка трасс остаётся для экспорта
+  void Remove(const QString &clientId);
+
+  // сохраняется каждая n-я трасса, а также все трассы не лучше нижней
+  // границы корзины p99 клиента: хвост приблизительный (с точностью до
+  // корзины, т.е. до 2 раз), зато трассы из корзины p99 не теряются
+  void SetSampleEvery(int n) noexcept { sampleEvery_ = qMax(1, n); }
+  bool ExportSamples(const QString &path, QString *error = nullptr) const;
+
+  const QHash<QString, ClientHistograms> &PerClient() const noexcept { return clients_; }
+
+private:
+  static constexpr int kMaxSamples = 10000;
+
+  QHash<QString, ClientHistograms> clients_;
+  QList<Sample> samples_;
+  int nextSample_ = 0;  // позиция записи в кольцевом буфере выборки
+  int sampleEvery_ = 100;
+  quint64 counter_ = 0;
+};
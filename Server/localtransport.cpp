@@ -0,0 +1,96 @@
+#include "localtransport.h"
+
+ShmRing::ShmRing(const QString &key)
+{
+  shm_.setNativeKey(QSharedMemory::legacyNativeKey(key));
+}
+
+ShmRing::~ShmRing()
+{
+  if(shm_.isAttached())
+    shm_.detach();
+}
+
+bool ShmRing::Create(qsizetype size)
+{
+  size &= ~qsizetype(7);
+  if(size < kHeaderSize) {
+    error_ = "ring size is too small";
+    return false;
+  }
+  if(!shm_.create(kHeaderSize + size)) {
+    error_ = shm_.errorString();
+    return false;
+  }
+
+  hdr_ = new (shm_.data()) Header();
+  hdr_->capacity = size;
+  hdr_->magic = kMagic;
+  capacity_ = size;
+  data_ = static_cast<char*>(shm_.data()) + kHeaderSize;
+  return true;
+}
+
+bool ShmRing::Attach()
+{
+  if(!shm_.attach()) {
+    error_ = shm_.errorString();
+    return false;
+  }
+
+  auto hdr = static_cast<Header*>(shm_.data());
+  if(shm_.size() < kHeaderSize || hdr->magic != kMagic
+      || hdr->capacity == 0 || hdr->capacity % 8
+      || hdr->capacity > quint64(shm_.size() - kHeaderSize)) {
+    error_ = "invalid ring header";
+    shm_.detach();
+    return false;
+  }
+
+  hdr_ = hdr;
+  capacity_ = hdr->capacity;
+  data_ = static_cast<char*>(shm_.data()) + kHeaderSize;
+  return true;
+}
+
+bool ShmRing::HasData() const
+{
+  return hdr_ && hdr_->head.load(std::memory_order_seq_cst)
+                     != hdr_->tail.load(std::memory_order_relaxed);
+}
+
+bool ShmRing::Write(const QByteArray &record, bool *wasEmpty)
+{
+  if(!hdr_)
+    return false;
+
+  const auto cap = capacity_;
+  const auto len = static_cast<quint32>(record.size());
+  const auto need = Padded(len);
+  if(need > cap / 2)
+    return false;
+
+  const auto start = hdr_->head.load(std::memory_order_relaxed);
+  auto h = start;
+  auto t = hdr_->tail.load(std::memory_order_acquire);
+  auto pos = h % cap;
+
+  // запись не разрывается: если до конца буфера не хватает места,
+  // остаток помечается маркером и запись начинается с начала
+  quint64 skip = pos + need > cap ? cap - pos : 0;
+  if(cap - (h - t) < skip + need)
+    return false;
+
+  if(skip) {
+    std::memcpy(data_ + pos, &kWrapMarker, sizeof(kWrapMarker));
+    h += skip;
+    pos = 0;
+  }
+
+  std::memcpy(data_ + pos, &len, sizeof(len));
+  std::memcpy(data_ + pos + sizeof(len), record.constData(), len);
+  hdr_->head.store(h + need, std::memory_order_seq_cst);
+  if(wasEmpty)
+    *wasEmpty = hdr_->tail.load(std::memory_order_seq_cst) == start;
+  return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QByteArray>
+#include <QSharedMemory>
+#include <QString>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+// Имя локального сокета (QLocalServer) для сервера, слушающего TCP-порт port.
+// Клиент на той же машине вычисляет его так же и подключается без TCP.
+inline QString LocalServerName(quint16 port)
+{
+  return QString("colibri-%1").arg(port);
+}
+
+// Кольцевой буфер записей в разделяемой памяти: один писатель (клиент),
+// один читатель (сервер). Позиции head/tail - атомарные счётчики в самом
+// сегменте; читатель разбирает записи прямо из сегмента. Читатель не
+// опрашивает буфер по таймеру: писатель будит его пустым кадром в сокете
+// (kDoorbell), только когда застал буфер пустым, поэтому при потоке
+// записей системный вызов нужен один на пачку, а в простое - ни одного.
+class ShmRing
+{
+public:
+  static constexpr qsizetype kDefaultSize = 4 * 1024 * 1024;
+  // кадр-звонок в сокете: QByteArray нулевой длины с префиксом QDataStream
+  static QByteArray Doorbell() { return QByteArray(sizeof(quint32), '\0'); }
+
+  explicit ShmRing(const QString &key);
+  ~ShmRing();
+
+  // создание сегмента (сервер) и подключение к нему (клиент)
+  bool Create(qsizetype size = kDefaultSize);
+  bool Attach();
+  QString ErrorString() const { return error_; }
+
+  // false, если записи не хватает места. wasEmpty - читатель успел забрать
+  // все предыдущие записи и его нужно разбудить звонком
+  bool Write(const QByteArray &record, bool *wasEmpty = nullptr);
+  // есть ли в буфере непрочитанные записи (для читателя)
+  bool HasData() const;
+
+  // вызывает fn(const QByteArray&) для каждой готовой записи; данные
+  // ссылаются на сегмент и действительны только внутри вызова.
+  // Возвращает число записей или -1 при повреждённом буфере.
+  // Сегмент доступен клиенту на запись, поэтому всё, что из него
+  // прочитано (позиции и длины), проверяется по собственной ёмкости.
+  template<typename F>
+  int ReadAll(F &&fn);
+
+private:
+  static constexpr quint32 kMagic = 0x436f4c52; // "CoLR"
+  static constexpr quint32 kWrapMarker = 0xFFFFFFFF;
+  static constexpr qsizetype kHeaderSize = 64;
+
+  struct Header
+  {
+    std::atomic<quint64> head{0}; // позиция записи (байт от начала работы)
+    std::atomic<quint64> tail{0}; // позиция чтения
+    quint64 capacity = 0; // только для Attach(), читатель ему не доверяет
+    quint32 magic = 0;
+  };
+  static_assert(sizeof(Header) <= kHeaderSize);
+  static_assert(std::atomic<quint64>::is_always_lock_free);
+
+  static quint64 Padded(quint32 len) noexcept { return (sizeof(quint32) + len + 7) & ~quint64(7); }
+
+  QSharedMemory shm_;
+  Header *hdr_ = nullptr;
+  quint64 capacity_ = 0; // размер области данных, зафиксированный при Create/Attach
+  char *data_ = nullptr;
+  QString error_;
+};
+
+template<typename F>
+int ShmRing::ReadAll(F &&fn)
+{
+  if(!hdr_)
+    return 0;
+
+  const auto cap = capacity_;
+  auto t = hdr_->tail.load(std::memory_order_relaxed);
+  auto h = hdr_->head.load(std::memory_order_acquire);
+  int n = 0;
+
+  if(h < t || h - t > cap) {
+    hdr_->tail.store(h, std::memory_order_release);
+    return -1;
+  }
+
+  while(t < h) {
+    auto pos = t % cap;
+    quint32 len;
+    std::memcpy(&len, data_ + pos, sizeof(len));
+
+    if(len == kWrapMarker) {
+      t += cap - pos;
+      continue;
+    }
+    if(pos + Padded(len) > cap || t + Padded(len) > h) {
+      hdr_->tail.store(h, std::memory_order_release);
+      return -1;
+    }
+
+    fn(QByteArray::fromRawData(data_ + pos + sizeof(len), len));
+    t += Padded(len);
+    ++n;
+  }
+
+  // маркер переноса не может указывать дальше head
+  if(t > h) {
+    hdr_->tail.store(h, std::memory_order_release);
+    return -1;
+  }
+
+  // seq_cst в паре с Write: либо писатель увидит, что буфер был пуст, и
+  // позвонит, либо читатель в HasData() увидит его новую запись
+  hdr_->tail.store(t, std::memory_order_seq_cst);
+  return n;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMetaType>
+
+// Временные метки прохождения одного сообщения от устройства до экрана.
+// sentMs/readMs - время по стенным часам (мс от эпохи), т.к. сравниваются
+// часы клиента и сервера; остальные стадии - монотонные часы сервера (нс).
+struct MsgTrace
+{
+  qint64 seq = -1;     // порядковый номер сообщения у клиента
+  qint64 sentMs = 0;   // отправка клиентом
+  qint64 readMs = 0;   // чтение из сокета
+  qint64 readNs = 0;   // чтение из сокета (одно на всю прочитанную пачку)
+  qint64 parseStartNs = 0; // начало разбора именно этого кадра
+  qint64 parseNs = 0;  // JSON разобран
+  qint64 emitNs = 0;   // передано из потока бизнес-логики
+  qint64 dequeueNs = 0;// извлечено из очереди потока GUI
+  qint64 renderNs = 0; // строка добавлена в таблицу
+
+  static qint64 NowNs()
+  {
+    static const QElapsedTimer clock = [] {
+      QElapsedTimer t;
+      t.start();
+      return t;
+    }();
+    return clock.nsecsElapsed();
+  }
+};
+
+Q_DECLARE_METATYPE(MsgTrace)
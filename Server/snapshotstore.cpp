@@ -0,0 +1,48 @@
+#include "snapshotstore.h"
+
+QJsonObject SnapshotStore::Apply(const QJsonObject &obj, QJsonObject *reply)
+{
+  auto type = obj.value("type").toString();
+
+  if(obj.contains("snap")) {
+    auto id = obj.value("snap").toInteger();
+    auto full = obj;
+    full.remove("snap");
+
+    auto &s = snapshots_[type];
+    s[1] = s[0];
+    s[0] = {id, full};
+
+    (*reply)["type"] = "SnapshotAck";
+    (*reply)["of"] = type;
+    (*reply)["snap"] = id;
+    return full;
+  }
+
+  if(!obj.value("delta").toBool())
+    return obj;
+
+  auto base = obj.value("base").toInteger();
+  auto it = snapshots_.constFind(type);
+  const Snapshot *snap = nullptr;
+  if(it != snapshots_.cend()) {
+    for(const auto &s : it.value())
+      if(s.id && s.id == base)
+        snap = &s;
+  }
+
+  if(!snap) {
+    (*reply)["type"] = "Command";
+    (*reply)["command"] = "resync";
+    (*reply)["of"] = type;
+    return {};
+  }
+
+  auto full = snap->fields;
+  for(auto f = obj.begin(); f != obj.end(); ++f) {
+    if(f.key() == "delta" || f.key() == "base")
+      continue;
+    full[f.key()] = f.value();
+  }
+  return full;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QHash>
+#include <QJsonObject>
+#include <array>
+
+// Восстановление полного состояния метрик клиента из полных снимков
+// и дельт относительно последнего подтверждённого снимка.
+class SnapshotStore
+{
+public:
+  // obj - входящее сообщение; возвращает полное сообщение для отображения
+  // или пустой объект, если дельту не к чему применить.
+  // В reply помещается ответ клиенту (подтверждение снимка или запрос
+  // повторной синхронизации), если он требуется.
+  QJsonObject Apply(const QJsonObject &obj, QJsonObject *reply);
+
+private:
+  struct Snapshot
+  {
+    qint64 id = 0;
+    QJsonObject fields;
+  };
+
+  // по типу метрик: текущий и предыдущий снимки (дельты, отправленные
+  // до получения клиентом подтверждения, ссылаются на предыдущий)
+  QHash<QString, std::array<Snapshot, 2>> snapshots_;
+};